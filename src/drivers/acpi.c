@@ -20,6 +20,7 @@
 #include <drivers/acpi.h>
 #include <time.h>
 #include <lib/memory.h>
+#include <paging.h>
 
 #define TIME_TO_WAIT	300
 #define DELAY		10
@@ -58,21 +59,31 @@ static UINT *acpiGetRSDPtr(void)
 	UINT *addr;
 	UINT *rsdp;
 
-	for (addr = (UINT *)0x000E0000; (int)addr < 0x00100000; addr += 0x10 / sizeof(addr)) {
+	for (addr = (UINT *)P2V(0x000E0000); (UINT)addr < P2V(0x00100000); addr += 0x10 / sizeof(addr)) {
 		rsdp = acpiCheckRSDPtr(addr);
 		if (rsdp) return rsdp;
 	}
-	int ebda = *((short *)0x40E);
-	ebda = (ebda * 0x10) & 0x000FFFFF;
-	for (addr = (UINT *)ebda; (int) addr < ebda + 1024; addr += 0x10 / sizeof(addr)) {
+	UINT ebda = *((USHORT *)P2V(0x40E));
+	ebda = P2V((ebda * 0x10) & 0x000FFFFF);
+	for (addr = (UINT *)ebda; (UINT) addr < ebda + 1024; addr += 0x10 / sizeof(addr)) {
 		rsdp = acpiCheckRSDPtr(addr);
 		if (rsdp) return rsdp;
 	}
 	return 0;
 }
 
+//The tables are in physical memory, anywhere
+static UINT *acpiMapTable(UINT phys)
+{
+	UINT *ptr = (UINT *)ioremap(phys, 8);
+
+	if (!ptr) return 0;
+	return (UINT *)ioremap(phys, *(ptr + 1));
+}
+
 static int acpiCheckHeader(UINT *ptr, const char *sig)
 {
+	if (!ptr) return -1;
 	if (!memcmp(ptr, sig, 4)) {
 		char *checkPtr = (char *)ptr;
 		int len = *(ptr + 1);
@@ -108,17 +119,18 @@ static int acpiEnable(void)
 int setup_ACPI(void)
 {
 	UINT *ptr = acpiGetRSDPtr();
-	if (!ptr || acpiCheckHeader(ptr, "RSDT")) return -1;
+	if (!ptr || acpiCheckHeader((ptr = acpiMapTable((UINT)ptr)), "RSDT")) return -1;
 	int entrys = *(ptr + 1);
 	entrys = (entrys - 36) / 4;
 	ptr += 9;
 	while (entrys--) {
-		if (!acpiCheckHeader((UINT *)*ptr, "FACP")) {
+		struct FACP *facp = (struct FACP *)acpiMapTable(*ptr);
+		if (!acpiCheckHeader((UINT *)facp, "FACP")) {
 			entrys = -2;
-			struct FACP *facp = (struct FACP *) * ptr;
-			if (!acpiCheckHeader((UINT *)facp->DSDT, "DSDT")) {
-				char *S5Addr = (char *)facp->DSDT + 36;
-				int dsdtLength = *(facp->DSDT + 1) - 36;
+			UINT *dsdt = acpiMapTable((UINT)facp->DSDT);
+			if (!acpiCheckHeader(dsdt, "DSDT")) {
+				char *S5Addr = (char *)dsdt + 36;
+				int dsdtLength = *(dsdt + 1) - 36;
 				while (dsdtLength--) {
 					if (!memcmp(S5Addr, "_S5_", 4)) break;
 					S5Addr++;
@@ -19,10 +19,28 @@
 
 #include <drivers/ata.h>
 #include <kernel/syscall.h>
+#include <kernel/dts.h>
+#include <task.h>
+
+static wait_queue ata_wait = {0};	//Both channels, woken by IRQ14 and IRQ15
+
+static void ata_irq(registers *regs)
+{
+	wake_up(&ata_wait);
+}
+
+void setup_ata(void)
+{
+	register_interrupt_handler(IRQ14, &ata_irq);
+	register_interrupt_handler(IRQ15, &ata_irq);
+	outportb(ATA_IDE_1 + ATA_CTRL, 0x00); //Clear nIEN, the drives raise their IRQ
+	outportb(ATA_IDE_2 + ATA_CTRL, 0x00);
+}
 
 int lba28_init(USHORT controller, UCHAR drive, UINT addr, UCHAR sectorcount)
 {
-	while ((inportb(controller + ATA_CHK2) & 0x80)) sys_pause();
+	//An idle drive raises no IRQ when BSY clears, so this one polls
+	while ((inportb(controller + ATA_CHK2) & 0x80)) switch_task();
 	outportb(controller | ATA_FEAT, 0x00);
 	outportb(controller | ATA_SECS, sectorcount);
 	outportb(controller | ATA_SNUM, (UCHAR) addr);
@@ -57,7 +75,7 @@ int lba28_read(UCHAR* buf, USHORT controller, UCHAR drive, UINT addr, UCHAR sect
 	if ((drive != ATA_MASTER) && (drive != ATA_SLAVE)) return 0;
 	if (!lba28_init(controller, drive, addr, sectorcount)) return 0;
 	outportb(controller | ATA_CMD, ATA_READ_CMD);
-	while (!(inportb(controller | ATA_CMD) & 0x08)) sys_pause();
+	wait_event(&ata_wait, inportb(controller | ATA_CMD) & 0x08);
 	for (i = 0; i < 256 * (sectorcount + 1); i++) {
 		value = inportw(controller);
 		buf[i*2] = (UCHAR) (value & 0xFF);
@@ -76,7 +94,8 @@ int lba28_write(UCHAR* buf, USHORT controller, UCHAR drive, UINT addr, UCHAR sec
 	if ((drive != ATA_MASTER) && (drive != ATA_SLAVE)) return 0;
 	if (!lba28_init(controller, drive, addr, sectorcount)) return 0;
 	outportb(controller | ATA_CMD, ATA_WRITE_CMD);
-	while (!(inportb(controller | ATA_CMD) & 0x08)) sys_pause();
+	//No IRQ for the first DRQ of a write either
+	while (!(inportb(controller | ATA_CMD) & 0x08)) switch_task();
 	for (i = 0; i < 256 * (sectorcount + 1); i++) {
 		value = buf[i*2];
 		value |= buf[i*2+1] << 8;
@@ -19,6 +19,7 @@
 
 #include <drivers/drivers.h>
 #include <drivers/fdc.h>
+#include <drivers/ata.h>
 #include <drivers/tty.h>
 #include <drivers/ramdisk.h>
 #include <mm.h>
@@ -66,7 +67,7 @@ void device_lock(vnode *node)
 		tmp->next = newreq;
 	}
 	sti();
-	while (dev->queue->pid != current_task->pid) sys_pause();
+	wait_event(&dev->lock_wait, dev->queue->pid == current_task->pid);
 }
 
 void device_unlock(vnode *node)
@@ -79,7 +80,7 @@ void device_unlock(vnode *node)
 	dev->queue = req->next;
 	free(req);
 	sti();
-	if (dev->queue) sys_kill(dev->queue->pid, SIGCONT);
+	if (dev->queue) wake_up(&dev->lock_wait);
 }
 
 inline pid_t requesting_pid(vnode *node)
@@ -121,6 +122,7 @@ UINT setup_drivers(void)
 	setup_tty();
 	setup_serial();
 	setup_floppy();
+	setup_ata();
 	setup_ramdisk();
 	return 0;
 }
@@ -27,7 +27,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 /* globals */
 static volatile UCHAR done = 0;
-static volatile pid_t thepid;
+static wait_queue fdc_wait = {0};
 static UCHAR dchange = 0;
 static UINT motor = 0;
 static int mtick = 0;
@@ -38,7 +38,10 @@ static UCHAR sr0 = 0;
 static UCHAR fdc_track = 0xff;
 static DrvGeom geometry = {DG144_HEADS, DG144_TRACKS, DG144_SPT};
 
-static unsigned long tbaddr = 0x80000L;    /* physical address of track buffer located below 1M */
+#define FDC_TBUF_ORDER	3	/* 32KB, one track of both heads fits, DMA never crosses 64KB */
+
+static char *tbuf = 0;			/* track buffer */
+static UINT tbaddr = 0;			/* its physical address, below 16M */
 
 static void recalibrate(void);
 static UINT flseek(int track);
@@ -81,8 +84,8 @@ static UINT waitfdc(UINT sensei)
 {
 	tmout = 1000;   /* set timeout to 1 second */
 	/* wait for IRQ6 handler to signal command finished */
-	thepid = sys_getpid();
-	while (!done && tmout) sys_pause();
+	wait_event(&fdc_wait, done || !tmout);
+	done = 0;
 	/* read in command result bytes */
 	statsz = 0;
 	while ((statsz < 7) && (inportb(FDC_MSR)&(1 << 4))) {
@@ -102,7 +105,8 @@ static UINT waitfdc(UINT sensei)
 
 static void FloppyIRQ(registers *regs)
 {
-	sys_kill(thepid, SIGCONT);
+	done = 1;
+	wake_up(&fdc_wait);
 	outportb(0x20, 0x20);
 }
 
@@ -179,9 +183,10 @@ static UINT flseek(int track)
 static UINT fdc_rw(int block, char *blockbuff, UINT cmd_read, ULONG nosectors)
 {
 	int head, track, sector, tries, copycount = 0;
-	char *p_tbaddr = (char *)0x80000;
+	char *p_tbaddr = tbuf;
 	char *p_blockbuff = blockbuff;
 
+	if (nosectors * FLOPPY_SECTOR_SIZE > (FRAME_SIZE << FDC_TBUF_ORDER)) return 0; /* track buffer too small */
 	block2hts(block, &head, &track, &sector); /* convert logical address into physical address */
 	motoron(); /* spin up the disk */
 	if (!cmd_read && blockbuff) {
@@ -234,7 +239,7 @@ static UINT fdc_rw(int block, char *blockbuff, UINT cmd_read, ULONG nosectors)
 	if (cmd_read && blockbuff) {
 		/* copy data from track buffer into data buffer */
 		p_blockbuff = blockbuff;
-		p_tbaddr = (char *) 0x80000;
+		p_tbaddr = tbuf;
 		for(copycount = 0; copycount < (nosectors * FLOPPY_SECTOR_SIZE); copycount++) {
 			*p_blockbuff = *p_tbaddr;
 			p_blockbuff++;
@@ -287,6 +292,7 @@ void setup_floppy(void)
 {
 	outportb(0x70, 0x10);
 	if (!inportb(0x71)) return;
+	if (!(tbuf = dma_alloc(FDC_TBUF_ORDER, &tbaddr))) return;
 	register_interrupt_handler(IRQ6, FloppyIRQ);
 	reset();
 	devfs_handle *dev = devfs_register_device(NULL, "fd0", 0660, FS_UID_ROOT, FS_GID_ROOT, FS_BLOCKDEVICE, &floppy_ops);
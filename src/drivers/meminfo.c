@@ -0,0 +1,128 @@
+/*
+ *  Copyright (C) 2008 Sven Köhler
+ *
+ *  This file is part of Nupkux.
+ *
+ *  Nupkux is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nupkux is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Nupkux.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <kernel.h>
+#include <errno.h>
+#include <mm.h>
+#include <fs/devfs.h>
+#include <kernel/ktextio.h>
+#include <lib/string.h>
+#include <lib/stdarg.h>
+
+#define MEMINFO_BUFSIZE	4096
+#define MEMINFO_LINE	96	//No line of the report is longer
+#define MEMINFO_TOP	10
+
+extern heap *kheap;
+extern int vsprintf(char *buf, const char *fmt, va_list args);
+
+//Appends while even the longest line still fits, the rest of the report is cut off
+static int meminfo_add(char *buf, int len, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (len + MEMINFO_LINE > MEMINFO_BUFSIZE) return len;
+	va_start(ap, fmt);
+	len += vsprintf(buf + len, fmt, ap);
+	va_end(ap);
+	return len;
+}
+
+#ifdef MM_TRACE_CALLERS
+static int meminfo_callers(char *buf, int len)
+{
+	UCHAR shown[MM_NR_CALLERS];
+	UINT i, j, best;
+
+	memset(shown, 0, sizeof(shown));
+	len = meminfo_add(buf, len, "\nCaller       Allocs   Blocks   Live\n");
+	for (i = 0; i < MEMINFO_TOP; i++) {
+		best = MM_NR_CALLERS;
+		for (j = 0; j < MM_NR_CALLERS; j++)
+			if (!shown[j] && mm_callers[j].live && (best == MM_NR_CALLERS || mm_callers[j].live > mm_callers[best].live)) best = j;
+		if (best == MM_NR_CALLERS) break;
+		shown[best] = 1;
+		len = meminfo_add(buf, len, "0x%08X %8u %8u %8u\n", mm_callers[best].caller, mm_callers[best].allocs, mm_callers[best].blocks, mm_callers[best].live);
+	}
+	return len;
+}
+#endif
+
+static int meminfo_report(char *buf)
+{
+	heap_info info;
+	kmem_cache *cache;
+	kmem_pool *pool;
+	UINT i;
+	int len;
+
+	heap_get_info(kheap, &info);
+	len = meminfo_add(buf, 0, "Frames:      %u total, %u free\n", nr_frames, nr_free_frames);
+	for (i = 0; i < mem_regions_count; i++)
+		len = meminfo_add(buf, len, "RAM:         0x%08X - 0x%08X\n", mem_regions[i].start, mem_regions[i].end);
+	len = meminfo_add(buf, len, "Heap:        %u bytes, %u used, %u peak\n", info.size, kheap->used, kheap->peak);
+	len = meminfo_add(buf, len, "Blocks:      %u live, %u allocs, %u frees\n", kheap->blocks, kheap->allocs, kheap->frees);
+	len = meminfo_add(buf, len, "Holes:       %u, %u bytes free, %u largest\n", info.holes, info.free, info.largest);
+	len = meminfo_add(buf, len, "Resizes:     %u expands, %u contracts (%u when idle)\n", kheap->expands, kheap->contracts, kheap->trims);
+	len = meminfo_add(buf, len, "Heap pages:  %u mapped, %u unmapped\n", kheap->pages_mapped, kheap->pages_unmapped);
+	len = meminfo_add(buf, len, "Reallocs:    %u in place, %u moved\n", kheap->reallocs_inplace, kheap->reallocs_moved);
+	len = meminfo_add(buf, len, "\nHole size    Count\n");
+	for (i = 0; i < MM_NR_BUCKETS; i++)
+		if (info.histogram[i]) len = meminfo_add(buf, len, ">= %-9u %u\n", 1 << i, info.histogram[i]);
+	len = meminfo_add(buf, len, "\nCache          Size   Slabs    Active   Allocs   Frees\n");
+	for (cache = kmem_caches; cache; cache = cache->next)
+		len = meminfo_add(buf, len, "%-14s %-6u %-8u %-8u %-8u %u\n", cache->name, cache->objsize, cache->nr_slabs, cache->active, cache->allocs, cache->frees);
+	len = meminfo_add(buf, len, "\nPool           Size   Free     Hits     Misses\n");
+	for (pool = kmem_pools; pool; pool = pool->next)
+		len = meminfo_add(buf, len, "%-14s %-6u %-8u %-8u %u\n", pool->name, pool->objsize, pool->nr_free, pool->hits, pool->misses);
+#ifdef MM_TRACE_CALLERS
+	len = meminfo_callers(buf, len);
+#endif
+	return len;
+}
+
+static int drv_meminfo_read(vnode *node, off_t offset, size_t size, char *buffer)
+{
+	char *report = malloc(MEMINFO_BUFSIZE);
+	int len;
+
+	if (!report) return -ENOMEM;
+	len = meminfo_report(report);
+	if (offset >= len) len = 0;
+	else {
+		len -= offset;
+		if (size < len) len = size;
+		memcpy(buffer, report + offset, len);
+	}
+	free(report);
+	return len;
+}
+
+extern int drv_null_write(vnode *node, off_t offset, size_t size, const char *buffer);
+static file_operations meminfo_ops = {
+read:
+	&drv_meminfo_read,
+write:
+	&drv_null_write,
+};
+
+void setup_meminfo_file(void)
+{
+	devfs_register_device(NULL, "meminfo", 0444, FS_UID_ROOT, FS_GID_ROOT, FS_CHARDEVICE, &meminfo_ops);
+}
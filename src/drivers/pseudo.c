@@ -23,6 +23,7 @@
 #include <task.h>
 
 extern void setup_urandom_file(void);
+extern void setup_meminfo_file(void);
 
 static int drv_stdin_read(vnode *node, off_t offset, size_t size, char *buffer)
 {
@@ -100,4 +101,5 @@ void setup_pseudo_devices(void)
 	devfs_register_device(NULL, "null", 0666, FS_UID_ROOT, FS_GID_ROOT, FS_CHARDEVICE, &null_ops);
 	devfs_register_device(NULL, "zero", 0666, FS_UID_ROOT, FS_GID_ROOT, FS_CHARDEVICE, &zero_ops);
 	setup_urandom_file();
+	setup_meminfo_file();
 }
@@ -111,5 +111,6 @@ void irq_tty_keyboard(registers *regs)
 		if (atty->in_e == TTY_INBUF_LEN) atty->in_e = 0;
 		if (atty->in_e == atty->in_s) //Buffer overflow
 			if (++atty->in_s == TTY_INBUF_LEN) atty->in_s = 0;
+		wake_up_prio(&atty->wait_input, PRIO_TTY);
 	}
 }
@@ -300,14 +300,14 @@ static int tty_read(vnode *node, off_t offset, size_t size, char *buffer)
 	size_t i = size;
 	tty *atty = (tty *)devicen_pdata(node);
 	while (i) {
-		sti(); //FIXME: Just delete it
-		if (atty->in_e != atty->in_s) {
-			*buffer = (char)atty->input_buffer[atty->in_s++];
-			if (atty->echo) tty_write(node, 0, 1, buffer);
-			if (atty->in_s == TTY_INBUF_LEN) atty->in_s = 0;
-			i--;
-			buffer++;
-		}
+		wait_event(&atty->wait_input, atty->in_e != atty->in_s);
+		cli();
+		*buffer = (char)atty->input_buffer[atty->in_s++];
+		if (atty->in_s == TTY_INBUF_LEN) atty->in_s = 0;
+		sti();
+		if (atty->echo) tty_write(node, 0, 1, buffer);
+		i--;
+		buffer++;
 	}
 	return size;
 }
@@ -339,6 +339,7 @@ static tty *create_tty(int nr)
 	res->show_cursor = 0;
 	res->mem = calloc(res->width * res->memlines, sizeof(USHORT));
 	res->in_e = res->in_s = 0;
+	res->wait_input.first = 0;
 	res->echo = 0;
 	res->dev = NULL;
 	return res;
@@ -20,10 +20,13 @@
 #include <fs/devfs.h>
 
 static devfs_handle *cache = 0;
+kmem_cache *devfs_handle_cache = 0;
 
 void devfs_create_cache(void)
 {
 	cache = 0;
+	if (!devfs_handle_cache)
+		devfs_handle_cache = kmem_cache_create("devfs_handle", sizeof(devfs_handle));
 }
 
 void devfs_add_to_cache(devfs_handle *handle)
@@ -45,7 +48,7 @@ void devfs_del_from_cache(devfs_handle *handle)
 	else prev->cache_next = handle->cache_next;
 	if (handle->f_op && handle->f_op->free_pdata)
 		handle->f_op->free_pdata(handle->pdata);
-	free(handle);
+	kmem_cache_free(devfs_handle_cache, handle);
 }
 
 devfs_handle *devfs_iget(ULONG ino)
@@ -65,7 +68,7 @@ void devfs_free_cache(void)
 		tmp = cache->cache_next;
 		if (cache->f_op && cache->f_op->free_pdata)
 			cache->f_op->free_pdata(cache->pdata);
-		free(cache);
+		kmem_cache_free(devfs_handle_cache, cache);
 		cache = tmp;
 	}
 }
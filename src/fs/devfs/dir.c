@@ -63,7 +63,7 @@ devfs_handle *devfs_register_device(devfs_handle *dir, const char *name, UINT mo
 {
 	if (!dir) dir = devfs_root;
 	if (!dir || !IS_DIR(dir)) return 0;
-	devfs_handle *handle = calloc(1, sizeof(devfs_handle));
+	devfs_handle *handle = kmem_cache_zalloc(devfs_handle_cache);
 	handle->ino = next_inode++;
 	handle->parent = dir;
 	handle->mode = mode;
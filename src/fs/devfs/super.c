@@ -58,7 +58,7 @@ void devfs_handle2vnode(vnode *node, devfs_handle *handle)
 
 static devfs_handle *devfs_empty_dir(ULONG ino, ULONG parent)
 {
-	devfs_handle *h = calloc(1, sizeof(devfs_handle));
+	devfs_handle *h = kmem_cache_zalloc(devfs_handle_cache);
 	devfs_d_entry *entr = calloc(2, sizeof(devfs_d_entry));
 
 	entr[0].inode = ino;
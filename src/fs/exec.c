@@ -29,27 +29,33 @@
 
 extern registers *glob_regs;
 
+//The strings come from the old image, a bad pointer in there fails the exec
 static char *write_vector(const char **vec, char *buf)
-{	//TODO: access_ok
-	if (!vec) return 0;
+{
+	const char *str;
+	char **ptrs;
 	int i, tmp, argc = 0;
-	char *oldbuf = buf;
-	while (vec[argc++]);
+
+	if (!vec) return 0;
+	do {
+		if (copy_from_user(&str, &vec[argc++], sizeof(char *))) return (char *)STACK_NOMEM;
+	} while (str);
 	i = argc - 1;
 	while (i--) {
-		tmp = strlen(vec[i]) + 1;
+		tmp = strnlen_user(vec[i], USER_STACK_SIZE);
+		if (!tmp || (tmp > USER_STACK_SIZE)) return (char *)STACK_NOMEM;
 		buf -= tmp;
-		strncpy(buf, vec[i], tmp);;
+		if (copy_from_user(buf, vec[i], tmp)) return (char *)STACK_NOMEM;
+		buf[tmp - 1] = 0;
 	}
-	buf -= sizeof(UINT *);
-	*((UINT *)buf) = 0;
-	i = argc - 1;
-	while (i--) {
-		tmp = strlen(vec[i]) + 1;
-		oldbuf -= tmp;
-		buf -= sizeof(UINT *);
-		*((UINT *)buf) = (UINT)oldbuf;
+	str = buf; //vec[0] is copied last, so it's the lowest
+	buf -= argc * sizeof(char *);
+	ptrs = (char **)buf;
+	for (i = 0; i < argc - 1; i++) {
+		ptrs[i] = (char *)str;
+		str += strlen(str) + 1;
 	}
+	ptrs[argc - 1] = 0;
 	return buf;
 }
 
@@ -57,8 +63,7 @@ UINT new_stack(UINT pos, UINT size)
 {
 	UINT i = 0;
 	for (i = pos; i >= (pos - size); i -= FRAME_SIZE)
-		make_page(i, PAGE_FLAG_PRESENT | PAGE_FLAG_WRITE | PAGE_FLAG_USERMODE, current_directory, 1);
-	flush_tlb();
+		make_zeroed_page(i, PAGE_FLAG_PRESENT | PAGE_FLAG_WRITE | PAGE_FLAG_USERMODE | PAGE_FLAG_STACK, current_directory);
 	return 0;
 }
 
@@ -70,9 +75,10 @@ UINT make_new_stack(const char **argv, const char **envp, UINT pos)
 	if ((args = write_vector(argv, esp)) == (char *)STACK_NOMEM) return STACK_NOMEM;
 	if (args) esp = args;
 	UINT i = 0;
-	while (argv[i++]);
+	if (args)
+		while (((char **)args)[i]) i++;
 	esp -= 3 * sizeof(UINT);
-	((UINT *)esp)[0] = i - 1;
+	((UINT *)esp)[0] = i;
 	((UINT *)esp)[1] = (UINT) args;
 	((UINT *)esp)[2] = (UINT) envs;
 	return (UINT)esp;
@@ -80,27 +86,26 @@ UINT make_new_stack(const char **argv, const char **envp, UINT pos)
 
 int do_exec(vnode *node, const char **argv, const char **envp)
 {
-	char *buf;
 	UINT entry, stack, fd = NR_OPEN;
 
 	open_fs(node, NULL);
-	buf = malloc(node->size);
-	read_fs(node, 0, node->size, buf);
-	close_fs(node);
+	if (load_elf(node, &entry, 1)) {
+		close_fs(node);
+		return -ENOEXEC;
+	}
 	new_stack(USER_STACK_POS, USER_STACK_SIZE);
 	if ((stack = make_new_stack(argv, envp, USER_STACK_POS)) == STACK_NOMEM) {
-		free(buf); //FIXME: The Stack is destroyed
+		close_fs(node); //FIXME: The Stack is destroyed
 		return -EFAULT;
 	}
-	if (load_elf(buf, &entry, 1)) {
-		free(buf);
+	//The old image goes, the new one comes page by page on demand
+	vma_unmap_all((vm_area **)&current_task->vmas, current_directory);
+	if (load_elf(node, &entry, 0)) {
+		close_fs(node);
 		return -ENOEXEC;
 	}
-	if (load_elf(buf, &entry, 0)) {
-		free(buf);
-		return -ENOEXEC;
-	}
-	free(buf);
+	close_fs(node);
+	current_task->brk_start = current_task->brk = vma_top(current_task->vmas);
 	while (fd--) {
 		if (current_task->files[fd] && current_task->close_on_exec&(1 << fd))
 			sys_close(fd);
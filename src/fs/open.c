@@ -63,11 +63,11 @@ int sys_open(const char *filename, int flag, int mode)
 	for (fd = 0; fd < NR_OPEN; fd++)
 		if (!current_task->files[fd]) break;
 	if (fd >= NR_OPEN) return -EMFILE;
-	f = malloc(sizeof(FILE));
+	f = kmem_cache_alloc(file_cache);
 	f->flags = 0;
 	f->node = namei(filename, &status);
 	if (!f->node) {
-		free(f);
+		kmem_cache_free(file_cache, f);
 		return status;
 	}
 	if (flag & O_APPEND) f->offset = f->node->size;
@@ -95,7 +95,7 @@ int sys_close(int fd)
 	if (f->count && !(--f->count)) {
 		close_fs(f->node);
 		iput(f->node);
-		free(f);
+		kmem_cache_free(file_cache, f);
 	}
 	return 0;
 }
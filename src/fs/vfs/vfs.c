@@ -25,6 +25,7 @@
 
 static filesystem_t *filesystems = 0;
 vnode *root_vnode = 0;
+kmem_cache *vnode_cache = 0, *file_cache = 0;
 
 filesystem_t *vfs_get_fs(const char *name)
 {
@@ -109,6 +110,8 @@ extern filesystem_t ext2_fs_type;
 
 int setup_vfs(void)
 {
+	vnode_cache = kmem_cache_create("vnode", sizeof(vnode));
+	file_cache = kmem_cache_create("file", sizeof(FILE));
 	register_filesystem(&rootfs_type);
 	vfsmount *mnt = calloc(1, sizeof(vfsmount));
 	super_block *sb = calloc(1, sizeof(super_block));
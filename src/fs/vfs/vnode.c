@@ -22,7 +22,7 @@
 
 static vnode *create_empty_inode(super_block *sb, ULONG ino)
 {
-	vnode *res = calloc(1, sizeof(vnode));
+	vnode *res = kmem_cache_zalloc(vnode_cache);
 	res->sb = sb;
 	res->ino = ino;
 	res->dev = sb->dev;
@@ -44,7 +44,7 @@ static void free_inode(vnode *node)
 	if (!prev)
 		node->sb->cache = node->cache_next;
 	else prev->cache_next = node->cache_next;
-	free(node);
+	kmem_cache_free(vnode_cache, node);
 }
 
 vnode *vfs_create_cache(void)
@@ -61,7 +61,7 @@ void free_sb_inodes(super_block *sb)
 		node->count = 1; //We are going to free all instances ... Well, let the filesystem think so.
 		if (sb->s_op->put_inode)
 			sb->s_op->put_inode(node);
-		free(node);
+		kmem_cache_free(vnode_cache, node);
 		node = tmp;
 	}
 }
@@ -37,10 +37,12 @@
 #define ATA_HDEV	6
 #define ATA_CMD		7
 #define ATA_CHK2	0x206
+#define ATA_CTRL	ATA_CHK2	//Written it's the device control, bit 1 is nIEN
 
 #define ATA_READ_CMD	0x20
 #define ATA_WRITE_CMD	0x30
 
+extern void setup_ata(void);
 extern int lba28_read(UCHAR* buf, USHORT controller, UCHAR drive, UINT addr, UCHAR sectorcount);
 extern int lba28_write(UCHAR* buf, USHORT controller, UCHAR drive, UINT addr, UCHAR sectorcount);
 
@@ -23,7 +23,7 @@
 #include <drivers/drivers.h>
 #include <lib/string.h>
 
-#define VIDEO_MEM	0xB8000
+#define VIDEO_MEM	P2V(0xB8000)
 #define TTY_WIDTH	80
 #define TTY_HEIGHT	25
 #define TTY_LINES	75	//25 visible lines + 50 linebuffer
@@ -58,6 +58,7 @@ typedef struct _tty {
 	USHORT width, height, memlines, viewln, scrln, esc_ind, attr;
 	USHORT *mem, in_s, in_e;
 	devfs_handle *dev;
+	wait_queue wait_input;	//Readers sleep here until a key arrives
 	tty_cursor cursor, _cursor;
 	USHORT input_buffer[TTY_INBUF_LEN];
 	char escape_seq[TTY_ESCAPE_LEN];
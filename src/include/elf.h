@@ -20,6 +20,8 @@
 #ifndef _ELF_H
 #define _ELF_H
 
+#include <fs/vfs.h>
+
 //I've only written supported values
 #define ELF_MAGIC	0x464C457F //Just for low-endian
 #define ELFCLASS32	1
@@ -88,6 +90,6 @@ typedef struct _elf32_phdr {
 #define LOAD_ELF_DYNAMIC	5
 #define LOAD_ELF_LOAD		6
 
-extern int load_elf(char *image, UINT *entry, int pretend);
+extern int load_elf(vnode *node, UINT *entry, int pretend);
 
 #endif
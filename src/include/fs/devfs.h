@@ -49,6 +49,7 @@ struct _devfs_handle {
 	/* Driver */
 	void *pdata;
 	request_t *queue;
+	wait_queue lock_wait;	//Woken when the head of queue changes
 	UINT bsize;   // Blocksize
 	ULONG bcount; // Blockcount if blk-dev
 	file_operations *f_op;
@@ -66,6 +67,8 @@ typedef struct _devfs_d_entry
 extern devfs_handle *devfs_register_device(devfs_handle *dir, const char *name, UINT mode, UINT uid, UINT gid, UINT type, file_operations *f_op);
 extern void devfs_unregister_device(devfs_handle *device);
 
+extern kmem_cache *devfs_handle_cache;
+
 extern void devfs_create_cache(void);
 extern void devfs_add_to_cache(devfs_handle *handle);
 extern void devfs_del_from_cache(devfs_handle *handle);
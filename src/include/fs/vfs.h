@@ -189,6 +189,8 @@ struct _filesystem_t {
 	filesystem_t *next;
 };
 
+extern kmem_cache *vnode_cache, *file_cache;
+
 extern int setup_vfs(void);
 extern int register_filesystem(filesystem_t *fs);
 extern int unregister_filesystem(filesystem_t *fs);
@@ -29,6 +29,7 @@ typedef unsigned char  UCHAR;
 typedef unsigned short USHORT;
 typedef unsigned int   UINT;
 typedef unsigned long  ULONG;
+typedef unsigned long long ULLONG;
 
 #ifndef NULL
 #define NULL    ((void *)0)
@@ -40,6 +41,10 @@ typedef unsigned int size_t;
 #endif
 typedef unsigned int off_t;
 
+#define KERNEL_VIRT_BASE	0xC0000000	//The kernel and the low physical memory are mapped from here on
+#define P2V(PHYS)		((PHYS) + KERNEL_VIRT_BASE)
+#define V2P(VIRT)		((VIRT) - KERNEL_VIRT_BASE)
+
 extern char _kabort_func;
 
 #define _kabort_func_break()	if (_kabort_func) { \
@@ -54,5 +59,8 @@ extern char _kabort_func;
 #define sti() asm volatile ("sti\n\t")
 #define cli() asm volatile ("cli\n\t")
 #define hlt() asm volatile ("hlt\n\t")
+//Like cli()/sti(), but leaves interrupts off if they already were
+#define irq_save(FLAGS) asm volatile ("pushf\n\tpopl %0\n\tcli":"=r"(FLAGS)::"memory")
+#define irq_restore(FLAGS) asm volatile ("pushl %0\n\tpopf"::"r"(FLAGS):"memory")
 
 #endif
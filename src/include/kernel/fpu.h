@@ -0,0 +1,46 @@
+/*
+ *  Copyright (C) 2008 Sven Köhler
+ *
+ *  This file is part of Nupkux.
+ *
+ *  Nupkux is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nupkux is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Nupkux.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _FPU_H
+#define _FPU_H
+
+#include <task.h>
+
+#define FPU_STATE_SIZE	512	//FXSAVE, FNSAVE needs 108 of it
+#define FPU_STATE(TASK)	((void *)(((UINT)(TASK)->fpu_state + 15) & ~15))	//FXSAVE wants 16 byte alignment
+
+#define CR0_MP		0x02
+#define CR0_EM		0x04
+#define CR0_TS		0x08
+#define CR4_OSFXSR	0x200
+#define CR4_OSXMMEXCPT	0x400
+
+#define CPUID_FEAT_FPU	0x01
+#define CPUID_FEAT_FXSR	0x1000000
+#define CPUID_FEAT_SSE	0x2000000
+
+#define MXCSR_DEFAULT	0x1F80	//All SIMD exceptions masked
+
+extern volatile task *fpu_owner;
+extern void setup_fpu(void);
+extern void fpu_switch(volatile task *next);
+extern void *fpu_copy(volatile task *atask);
+extern void fpu_release(volatile task *atask);
+
+#endif
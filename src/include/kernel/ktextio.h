@@ -30,7 +30,7 @@
 #define NEWLINE_KIN
 #define STRLEN		255
 
-#define VIDEO_MEM_ENTRY	0xB8000
+#define VIDEO_MEM_ENTRY	P2V(0xB8000)
 
 #define TXT_COL_WHITE	0x07
 
@@ -25,8 +25,10 @@
 #include <task.h>
 #include <unistd.h>
 #include <errno.h>
+#include <sys/mman.h>
+#include <time.h>
 
-#define NR_SYSCALLS	128
+#define NR_SYSCALLS	256
 
 extern void setup_syscalls(void);
 
@@ -54,5 +56,9 @@ extern int sys_chroot(const char *name);
 extern int sys_dup2(int fd, int fd2);
 extern pid_t sys_getppid(void);
 extern int sys_reboot(int howto);
+extern UINT sys_brk(UINT addr);
+extern int sys_mmap(struct mmap_args *args);
+extern int sys_munmap(UINT addr, size_t len);
+extern int sys_nanosleep(const struct timespec *req, struct timespec *rem);
 
 #endif
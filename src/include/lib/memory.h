@@ -22,6 +22,9 @@
 
 #include <kernel.h>
 
+extern UCHAR mem_fast_strings;
+extern void setup_memory_functions(void);
+
 extern void *memcpy(void *target, const void *src, size_t count);
 extern void *memset(void *target, int value, size_t count);
 extern USHORT *memsetw(USHORT *target, int value, size_t count);
@@ -34,21 +34,41 @@
 #define MM_KHEAP_START	0x40000		//256KB after kmalloc_pos
 #define MM_KHEAP_SIZE	0x300000	//Add this to above and clear up the mess!
 #define MM_KHEAP_MIN	0x100000
-#define MM_INDEX_COUNT	0x800
+#define MM_KHEAP_END	IOREMAP_BASE
+#define MM_TRIM_KEEP	0x10000		//Free Bytes left at the end when the heap shrinks
+#define MM_TRIM_HIGH	0x40000		//A free tail this big is given back at once, smaller ones when idle
+#define MM_NR_BUCKETS	32		//Hole size classes, one per power of two
+#define MM_ALIGN		8
 
 #define MM_FLAG_BLOCK	0
 #define MM_FLAG_HOLE	1
 
 #define MM_NO_HOLE	-1
 
+#define KMEM_MAGIC		0x626C6153
+#define KMEM_ALIGN		8
+#define KMEM_MAP_WORDS	((0x1000 / KMEM_ALIGN + 31) / 32)	//One in-use bit per object of a slab (one page)
+#define KMEM_MAX_EMPTY	1	//Empty slabs kept per cache before giving pages back
+#define KMALLOC_MIN_SHIFT	4	//Smallest size class: 16 Bytes
+#define KMALLOC_MAX_SHIFT	10	//Biggest size class: 1024 Bytes, above goes to the heap
+#define NR_KMALLOC_CACHES	(KMALLOC_MAX_SHIFT - KMALLOC_MIN_SHIFT + 1)
+#define KMEM_POOL_MAX		16	//Free objects a pool can hold
+
 typedef struct _mm_header mm_header;
 typedef struct _mm_footer mm_footer;
+typedef struct _mm_hole mm_hole;
 typedef struct _heap heap;
+typedef struct _kmem_slab kmem_slab;
+typedef struct _kmem_cache kmem_cache;
+typedef struct _kmem_pool kmem_pool;
 
 struct _mm_header {
 	UINT magic;
 	UINT size: 31;
 	UCHAR flag: 1;
+#ifdef MM_TRACE_CALLERS
+	UINT caller;
+#endif
 };
 
 struct _mm_footer {
@@ -56,14 +76,79 @@ struct _mm_footer {
 	mm_header *header;
 };
 
+struct _mm_hole {
+	mm_header header;
+	mm_hole *prev, *next;
+};
+
+#define MM_MIN_BLOCK	(sizeof(mm_hole) + sizeof(mm_footer))
+
 struct _heap {
-	mm_header **entries;
-	UINT entrycount;
-	UINT maxentries;
+	mm_hole *buckets[MM_NR_BUCKETS];	//Bucket i holds the holes of 2^i to 2^(i+1)-1 Bytes
+	UINT bucketmap;
+	UINT holes;
 	UINT start;
 	UINT end;
 	UINT memend;
 	UINT pageflags;
+	/* Statistics */
+	UINT allocs, frees;
+	UINT blocks, used, peak;	//Bytes of blocks, headers included
+	UINT expands, contracts, trims;	//trims: contracts done by heap_trim
+	UINT pages_mapped, pages_unmapped;
+	UINT reallocs_inplace, reallocs_moved;
+};
+
+typedef struct _heap_info {
+	UINT size;
+	UINT holes, free, largest;
+	UINT histogram[MM_NR_BUCKETS];	//Holes per bucket
+} heap_info;
+
+#ifdef MM_TRACE_CALLERS
+#define MM_NR_CALLERS	64
+
+typedef struct _mm_caller {
+	UINT caller;		//Return address of malloc, 0 for the _kmalloc* family
+	UINT allocs;
+	UINT blocks, live;
+} mm_caller;
+
+extern mm_caller mm_callers[MM_NR_CALLERS];
+#endif
+
+/* One slab is one page taken from kheap, this header sits at its start */
+struct _kmem_slab {
+	UINT magic;
+	kmem_slab *self;
+	kmem_cache *cache;
+	kmem_slab *prev, *next;
+	void *freelist;
+	UINT inuse;
+	UINT inuse_map[KMEM_MAP_WORDS];
+};
+
+struct _kmem_cache {
+	const char *name;
+	UINT objsize;
+	UINT perslab;
+	kmem_slab *partial, *full, *empty;
+	UINT nr_slabs, nr_empty;
+	/* Statistics */
+	UINT allocs, frees, active;
+	kmem_cache *next;
+};
+
+/* Page aligned objects (stacks, page tables) stay here when freed, untouched */
+struct _kmem_pool {
+	const char *name;
+	UINT objsize;
+	UINT limit;
+	UINT nr_free;
+	UINT objs[KMEM_POOL_MAX];
+	/* Statistics */
+	UINT hits, misses;
+	kmem_pool *next;
 };
 
 extern UINT _kmalloc(UINT sz);
@@ -74,5 +159,22 @@ extern void free(void *ptr);
 extern void *realloc(void *ptr, UINT size);
 
 extern heap *create_heap(UINT start, UINT end, UINT memend, UINT pageflags);
+extern void heap_get_info(heap *aheap, heap_info *info);
+extern void heap_trim(heap *aheap);
+
+extern kmem_cache *kmem_caches;
+extern kmem_cache *kmem_cache_create(const char *name, UINT objsize);
+extern void *kmem_cache_alloc(kmem_cache *cache);
+extern void *kmem_cache_zalloc(kmem_cache *cache);
+extern void kmem_cache_free(kmem_cache *cache, void *obj);
+extern void setup_kmalloc_caches(void);
+extern void *kmalloc_small(UINT size);
+extern UINT kmalloc_obj_size(const void *ptr);
+extern int kmalloc_free_obj(void *ptr);
+
+extern kmem_pool *kmem_pools;
+extern void kmem_pool_init(kmem_pool *pool, const char *name, UINT objsize, UINT limit);
+extern void *kmem_pool_alloc(kmem_pool *pool, UINT *phys);
+extern void kmem_pool_free(kmem_pool *pool, void *obj);
 
 #endif
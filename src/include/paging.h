@@ -24,12 +24,18 @@
 #include <mm.h>
 
 #define FRAME_SIZE		0x1000
+#define LARGE_PAGE_SIZE	0x400000
 #define PAGE_FLAG_PRESENT	0x01
 #define PAGE_FLAG_WRITE		0x02
 #define PAGE_FLAG_USERMODE	0x04
 //not for "daily use"
 #define PAGE_FLAG_ACCESSED	0x20
 #define PAGE_FLAG_DIRTY		0x40
+#define PAGE_FLAG_LARGE		0x80	//Directory entry maps 4MB itself, only with CR4.PSE
+#define PAGE_FLAG_GLOBAL	0x100	//Survives CR3 reloads, only with CR4.PGE
+//free for the os
+#define PAGE_FLAG_COW		0x200	//Shared read-only after fork, copied on write
+#define PAGE_FLAG_STACK		0x400	//Never shared, faults are pushed onto it
 //dummies
 #define PAGE_FLAG_NOTPRESENT	0x00
 #define PAGE_FLAG_READONLY		0x00
@@ -52,16 +58,69 @@
 
 #define flush_tlb() asm volatile("movl %cr3,%eax\n\t" \
 				"movl %eax,%cr3\n\t");
+#define invlpg(ADDR) asm volatile("invlpg (%0)"::"r"(ADDR):"memory")
+
+#define CPUID_FEAT_PSE	0x08
+#define CPUID_FEAT_PGE	0x2000
+#define CR4_PSE		0x10
+#define CR4_PGE		0x80
+
+#define FRAME_FLAG_USED		0x01
+#define FRAME_FLAG_FREE		0x02	//Heads a free block of the buddy allocator
+
+#define NO_FRAME		0xFFFFFFFF
+
+#define MAX_ORDER		10	//Biggest block: 2^10 frames, 4MB
+#define ZERO_POOL_SIZE	64	//Cleared frames kept for anonymous memory
+#define ZONE_DMA		0	//Below 16MB, reachable by ISA DMA
+#define ZONE_NORMAL		1
+#define NR_ZONES		2
+#define DMA_ZONE_END	0x1000000
+
+#define PAGE_ALLOC_DMA	0x01
+
+#define NR_MEM_REGIONS	16	//Usable RAM ranges taken from the multiboot memory map
+
+#define DMA_VIRT_BASE	0xF0000000	//The DMA zone is mapped here, 1:1 shifted
+#define DMA_VIRT(PHYS)	(DMA_VIRT_BASE + (PHYS))
+
+/*
+ * Below KERNEL_VIRT_BASE every process has its own tables, above it all
+ * directories share the ones of the kernel: low memory at P2V(phys), then
+ * the kernel heap, ioremap, kmap and the DMA window.
+ */
+#define KERNEL_PDE_FIRST	(KERNEL_VIRT_BASE / LARGE_PAGE_SIZE)
+#define IOREMAP_BASE	0xEF800000	//Firmware tables, mapped once and kept
+#define IOREMAP_END		KMAP_BASE
+#define KMAP_BASE		0xEFC00000	//One page table of temporary mappings below the DMA window
+#define KM_SRC			0	//Slots of kmap()
+#define KM_DST			1
+#define KMAP_SLOTS		2
 
 typedef struct _page_directory page_directory;
 typedef struct _page_table page_table;
 typedef struct _page page;
+typedef struct _frame frame;
+typedef struct _mem_region mem_region;
 
 struct _page {
 	UINT flags: 12;
 	UINT frame: 20;
 };
 
+/* One for each physical frame */
+struct _frame {
+	USHORT count;		//How many pages map it
+	UCHAR flags;
+	UCHAR order;		//Size of the free block it heads
+	UINT prev, next;	//Free list of its order, NO_FRAME terminates
+};
+
+/* Page aligned, end is the first byte behind */
+struct _mem_region {
+	UINT start, end;
+};
+
 struct _page_table {
 	page entries[1024];
 };
@@ -74,15 +133,30 @@ struct _page_directory {
 
 extern UINT kernel_end;		//Defined in link.ld
 extern ULONG memory_end;	//Defined in main.c
+extern mem_region mem_regions[NR_MEM_REGIONS];
+extern UINT mem_regions_count;
 extern UINT __working_memstart;
 extern page_directory *current_directory;
+extern UINT nr_frames, nr_free_frames;
 
 extern page_directory* clone_directory(page_directory* src);
 extern void free_directory(page_directory *dir);
 extern page *make_page(UINT address, UINT flags, page_directory *directory, int alloc);
+extern page *make_zeroed_page(UINT address, UINT flags, page_directory *directory);
+extern page *map_zero_page(UINT address, UINT flags, page_directory *directory);
+extern void refill_zero_pool(UINT count);
 extern page *get_page(UINT address, int make, page_directory *directory);
 extern page *free_page(UINT address, page_directory *directory);
 extern int access_ok(int type, const void* addr, UINT size);
+extern UINT copy_from_user(void *to, const void *from, UINT n);
+extern UINT copy_to_user(void *to, const void *from, UINT n);
+extern UINT strnlen_user(const char *s, UINT max);
+extern UINT alloc_pages(UINT order, UINT flags);
+extern void free_pages(UINT phys, UINT order);
+extern void *kmap(UINT slot, UINT phys);
+extern void *ioremap(UINT phys, UINT size);
+extern void *dma_alloc(UINT order, UINT *phys);
+extern void dma_free(void *addr, UINT order);
 extern void setup_paging(void);
 
 #endif
@@ -23,6 +23,8 @@
 #include <kernel.h>
 #include <paging.h>
 #include <fs/vfs.h>
+#include <vma.h>
+#include <time.h>
 
 #define TASK_RUNNING		0
 #define TASK_WAITING		1
@@ -33,13 +35,28 @@
 #define ROOT_UID	0
 #define I_AM_ROOT()	(!(current_task->uid && current_task->euid))
 
-#define NR_TASKS	64
+#define TASK_MAX	1024	//Every task costs a page directory and stacks
+#define PID_MAX		32768
+#define PID_HASH_SIZE	64
+#define PID_HASH(PID)	((PID) & (PID_HASH_SIZE - 1))
 #define NO_TASK		(-1)
 
+#define NR_PRIORITIES	8	//0 is the highest, one run queue each
+#define PRIO_TTY	1	//Readers woken by the keyboard
+#define PRIO_DEFAULT	4
+#define PRIO_IDLE	NR_PRIORITIES	//The kernel task run because nothing else is ready
+#define SCHED_SLICE(PRIO)	(NR_PRIORITIES - (PRIO))	//Scheduler ticks, longer for higher priorities
+
 #define KERNEL_STACK_SIZE 2048
+#define BOOT_STACK_TOP	KERNEL_VIRT_BASE	//The first stack of the kernel, copied on fork like the user's
+#define BOOT_STACK_SIZE	0x2000
 
 typedef struct _task task;
 
+typedef struct _wait_queue {
+	volatile struct _task *first;	//Linked through wait_next, oldest first
+} wait_queue;
+
 #ifndef _PID_T
 #define _PID_T
 typedef int pid_t;
@@ -49,8 +66,22 @@ struct _task
 {
 	pid_t pid, parent, pgrp;
 	char priority, state;
+	char run_prio;		//Queue the task is on (or was taken from)
+	int time_slice;
+	volatile struct _task *run_next, *run_prev;	//Run queue or blocked list
+	volatile struct _task *wait_next;
+	wait_queue *wait_on;
+	wait_queue wait_exit;	//Woken when the task becomes a zombie
+	timer sleep_timer;
+	wait_queue wait_sleep;	//Woken by sleep_timer
+	volatile struct _task *all_next, *all_prev;	//task_list
+	volatile struct _task *hash_next;
+	volatile struct _task *children, *sibling_next, *sibling_prev;
 	UINT esp, ebp, eip;
+	void *fpu_state;	//FXSAVE area, 0 until the task uses the FPU
 	page_directory *directory;
+	vm_area *vmas;
+	UINT brk_start, brk;	//Heap of the process
 	UINT kernel_stack;
 	USHORT uid, euid;
 	USHORT gid, egid;
@@ -62,9 +93,32 @@ struct _task
 };
 
 extern volatile task *current_task;
+extern volatile task *kernel_task;
+extern volatile task *task_list;
+extern UINT nr_tasks;
+extern kmem_pool kstack_pool;
 extern void setup_tasking(void);
+extern volatile task *find_task(pid_t pid);
+extern void reparent_children(volatile task *atask);
+extern void release_task(volatile task *atask);
+extern void free_task_memory(volatile task *atask);
 extern void switch_task(void);
+extern void sched_add_task(volatile task *atask);
+extern void wake_up_task(volatile task *atask, int prio);
+extern int sched_tick(void);
+extern int sched_need_tick(void);
+extern void sleep_on(wait_queue *queue);
+extern void wake_up_prio(wait_queue *queue, int prio);
 extern void move_stack(void *new_stack, UINT size);
 extern void abort_current_process(void);
 
+//COND is checked with interrupts off, so a wake_up() between check and sleep isn't lost
+#define wake_up(QUEUE)	wake_up_prio((QUEUE), PRIO_IDLE)	//Everybody at their own priority
+#define wait_event(QUEUE, COND)	do { \
+		UINT __flags; \
+		irq_save(__flags); \
+		while (!(COND)) sleep_on(QUEUE); \
+		irq_restore(__flags); \
+	} while (0)
+
 #endif
@@ -28,6 +28,25 @@ typedef long time_t;
 #endif
 typedef long clock_t;
 
+#define PIT_HZ		1193182
+#define NSEC_PER_SEC	1000000000
+
+struct timespec {
+	time_t tv_sec;
+	long tv_nsec;
+};
+
+typedef struct _timer timer;
+
+//One-shot, func runs in the timer interrupt
+struct _timer {
+	ULLONG expires;		//PIT cycles since boot
+	void (*func)(void *data);
+	void *data;
+	timer *next;
+	volatile UCHAR pending;
+};
+
 struct tm {
 	int tm_sec;      /* Sekunden - [0,59] */
 	int tm_min;      /* Minuten - [0,59] */
@@ -40,7 +59,10 @@ struct tm {
 	int tm_isdst;    /* Sommerzeit-Flag */
 };
 
-extern ULONG ticks;
+extern ULLONG clock_cycles(void);
+extern void add_timer(timer *atimer);
+extern void timer_resched(void);
+extern void timer_wake(void *queue);
 extern time_t time(time_t *tp);
 extern time_t mktime(struct tm *timeptr);
 //Write a ctime, it will make things much easyer
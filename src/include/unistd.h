@@ -93,6 +93,9 @@ typedef int ssize_t;
 #define __NR_dup2	63
 #define __NR_getppid	64
 #define __NR_reboot	88
+#define __NR_mmap	90
+#define __NR_munmap	91
+#define __NR_nanosleep	162
 
 #define _syscall0(type,name) \
 type name(void) \
@@ -184,4 +187,7 @@ _decl_syscall2(int, dup2, int, fd, int, fd2);
 _decl_syscall0(pid_t, getppid);
 _decl_syscall1(int, reboot, int, howto);
 
+extern int brk(void *addr);
+extern void *sbrk(int increment);
+
 #endif
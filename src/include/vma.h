@@ -0,0 +1,51 @@
+/*
+ *  Copyright (C) 2008 Sven Köhler
+ *
+ *  This file is part of Nupkux.
+ *
+ *  Nupkux is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nupkux is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Nupkux.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _VMA_H
+#define _VMA_H
+
+#include <kernel.h>
+#include <paging.h>
+#include <fs/vfs.h>
+
+#define USER_MMAP_BASE	0x40000000	//Anonymous mappings are placed from here on,
+#define USER_MMAP_END	0x70000000	//the heap (brk) stays below, the stack above
+
+typedef struct _vm_area vm_area;
+
+/* A range of a process which gets its pages on the first access */
+struct _vm_area {
+	UINT start, end;	//Page aligned, end is the first page behind
+	UINT flags;		//Page flags once a page is faulted in
+	vnode *node;		//0 for anonymous memory
+	off_t offset;		//Position of start in node
+	UINT filesz;		//Bytes behind start which come from node, the rest is zero
+	vm_area *next;
+};
+
+extern vm_area *vma_find(vm_area *list, UINT address);
+extern vm_area *vma_overlap(vm_area *list, UINT start, UINT end);
+extern UINT vma_top(vm_area *list);
+extern int vma_map(vm_area **list, UINT address, UINT size, UINT flags, vnode *node, off_t offset, UINT filesz);
+extern vm_area *vma_clone(vm_area *list);
+extern int vma_unmap(vm_area **list, UINT start, UINT end, page_directory *directory);
+extern void vma_unmap_all(vm_area **list, page_directory *directory);
+extern int vma_fault(UINT address, int write);
+
+#endif
@@ -22,14 +22,14 @@
 #include <errno.h>
 #include <kernel/ktextio.h>
 #include <signal.h>
-
-extern volatile task tasks[NR_TASKS];
+#include <kernel/fpu.h>
 
 static int send_signal(volatile task *atask, int sign) //Just inside the kernel
 {
 	if (I_AM_ROOT() || atask->uid == current_task->uid || atask->uid == current_task->euid
 	        || atask->euid == current_task->uid || atask->euid == current_task->euid || sign == SIGCONT) {
 		atask->signals |= (1 << (sign - 1));
+		if (atask->state == TASK_BLOCKED) wake_up_task(atask, atask->priority);
 		return 0;
 	}
 	return -EPERM;
@@ -37,34 +37,22 @@ static int send_signal(volatile task *atask, int sign) //Just inside the kernel
 
 int sys_kill(pid_t pid, int sign)
 {
+	volatile task *atask;
+	int ret, perm = 0, found = 0;
+
 	if (sign < 1 || sign > 32)
 		return -EINVAL;
-	pid_t i = 0;
-	int ret = -1, perm = 0, found = 0;
-	if (!pid) for (; i < NR_TASKS; i++) {
-			if (tasks[i].pid != NO_TASK && tasks[i].pgrp == current_task->pgrp) {
-				ret = send_signal(&(tasks[i]), sign);
-				found = 1;
-				if (ret != -EPERM) perm = 1;
-			}
-		}
-	else if (pid == -1) for (; i < NR_TASKS; i++) {
-			if (tasks[i].pid != NO_TASK) {
-				ret = send_signal(&(tasks[i]), sign);
-				found = 1;
-				if (ret != -EPERM) perm = 1;
-			}
-		}
-	else if (pid < -1) for (; i < NR_TASKS; i++) {
-			if (tasks[i].pid != NO_TASK && tasks[i].pgrp == -pid) {
-				ret = send_signal(&(tasks[i]), sign);
-				found = 1;
-				if (ret != -EPERM) perm = 1;
-			}
-		}
-	else if (pid > NR_TASKS || tasks[pid].pid == NO_TASK) {
-		return -ESRCH;
-	} else return send_signal(&(tasks[pid]), sign);
+	if (pid > 0) {
+		if (!(atask = find_task(pid))) return -ESRCH;
+		return send_signal(atask, sign);
+	}
+	for (atask = task_list; atask; atask = atask->all_next) {
+		if ((!pid && atask->pgrp != current_task->pgrp) || (pid < -1 && atask->pgrp != -pid))
+			continue;
+		ret = send_signal(atask, sign);
+		found = 1;
+		if (ret != -EPERM) perm = 1;
+	}
 	if (!found) return -ESRCH;
 	if (!perm) return -EPERM;
 	return 0;
@@ -73,10 +61,9 @@ int sys_kill(pid_t pid, int sign)
 int sys_exit(int status)
 {
 	UINT i;
+	volatile task *parent;
 	cli(); //switch_task does sti()
-	for (i = 0; i < NR_TASKS; i++)
-		if (tasks[i].pid != NO_TASK && tasks[i].parent == current_task->pid)
-			tasks[i].parent = 1; //INIT inherits the orphan
+	reparent_children(current_task);
 	for (i = NR_OPEN; i--;)
 		if (current_task->files)
 			sys_close(i);
@@ -87,24 +74,25 @@ int sys_exit(int status)
 	}
 	current_task->state = TASK_ZOMBIE;
 	current_task->exit_code = status;
-	sys_kill(current_task->parent, SIGCHLD);
-	free_directory(current_task->directory);
-	free((void *)current_task->kernel_stack);
+	wake_up((wait_queue *)&current_task->wait_exit);
+	if ((parent = find_task(current_task->parent))) send_signal(parent, SIGCHLD);
+	vma_unmap_all((vm_area **)&current_task->vmas, current_task->directory);
+	free_task_memory(current_task); //Not yet, we still run on them
+	fpu_release(current_task);
 	switch_task();
 	return -EGENERIC;
 }
 
 pid_t sys_waitpid(pid_t pid, int *statloc, int options)
 {
-	if (pid <= 0 || pid >= NR_TASKS) return -ECHILD;
-	while (tasks[pid].state != TASK_ZOMBIE);
-	if (statloc) {
-		if (!access_ok(VERIFY_WRITE, statloc, sizeof(int))) {
-			tasks[pid].pid = NO_TASK;
-			return -EFAULT;
-		}
-		*statloc = tasks[pid].exit_code;
-	}
-	tasks[pid].pid = NO_TASK;
+	volatile task *child;
+	int status;
+
+	if (pid <= 0 || !(child = find_task(pid))) return -ECHILD;
+	wait_event((wait_queue *)&child->wait_exit, !(child = find_task(pid)) || child->state == TASK_ZOMBIE);
+	if (!child) return -ECHILD; //Somebody else reaped it
+	status = child->exit_code;
+	release_task(child);
+	if (statloc && copy_to_user(statloc, &status, sizeof(int))) return -EFAULT;
 	return pid;
 }
@@ -0,0 +1,131 @@
+/*
+ *  Copyright (C) 2008 Sven Köhler
+ *
+ *  This file is part of Nupkux.
+ *
+ *  Nupkux is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nupkux is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Nupkux.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The FPU/SSE registers are switched lazily. switch_task() only sets CR0.TS
+ * when the next task doesn't own the FPU, its first FPU instruction traps
+ * (#NM) and only then the owner's registers are saved and the new ones
+ * loaded. A task gets its save area on its first FPU instruction, so tasks
+ * that never use the FPU cost nothing at all.
+ */
+
+#include <kernel/fpu.h>
+#include <kernel/dts.h>
+#include <kernel/ktextio.h>
+#include <lib/memory.h>
+
+volatile task *fpu_owner = 0;	//Whose state is in the registers
+
+static UCHAR fpu_present = 0, fpu_fxsr = 0, fpu_sse = 0;
+static kmem_cache *fpu_cache = 0;
+
+static void set_ts(void)
+{
+	asm volatile (	"movl %%cr0,%%eax\n\t"
+	                "orl  %0,%%eax\n\t"
+	                "movl %%eax,%%cr0"::"i"(CR0_TS):"eax");
+}
+
+static void fpu_save(volatile task *atask)
+{
+	if (fpu_fxsr) asm volatile ("fxsave (%0)"::"r"(FPU_STATE(atask)):"memory");
+	else asm volatile ("fnsave (%0)\n\tfwait"::"r"(FPU_STATE(atask)):"memory"); //Reinitializes the FPU
+}
+
+static void fpu_restore(volatile task *atask)
+{
+	if (fpu_fxsr) asm volatile ("fxrstor (%0)"::"r"(FPU_STATE(atask)):"memory");
+	else asm volatile ("frstor (%0)"::"r"(FPU_STATE(atask)):"memory");
+}
+
+//#NM, the current task touched the FPU while CR0.TS was set
+static void fpu_trap(registers *regs)
+{
+	UINT mxcsr = MXCSR_DEFAULT;
+
+	asm volatile ("clts");
+	if (fpu_owner == current_task) return;
+	if (fpu_owner) fpu_save(fpu_owner);
+	fpu_owner = current_task;
+	if (current_task->fpu_state) {
+		fpu_restore(current_task);
+		return;
+	}
+	if (!(current_task->fpu_state = kmem_cache_alloc(fpu_cache))) {
+		fpu_owner = 0;
+		printf("\nNo memory for the FPU state\n");
+		abort_current_process();
+		return;
+	}
+	asm volatile ("fninit");
+	if (fpu_sse) asm volatile ("ldmxcsr %0"::"m"(mxcsr));
+}
+
+void fpu_switch(volatile task *next)
+{
+	if (!fpu_present) return;
+	if (next == fpu_owner) asm volatile ("clts");
+	else set_ts();
+}
+
+//A copy of the FPU state for a forked child, 0 if there's none or no memory
+void *fpu_copy(volatile task *atask)
+{
+	void *res;
+	UINT flags;
+
+	if (!atask->fpu_state || !(res = kmem_cache_alloc(fpu_cache))) return 0;
+	irq_save(flags);
+	if (fpu_owner == atask) {
+		fpu_save(atask); //CR0.TS is clear, the owner is running
+		if (!fpu_fxsr) fpu_restore(atask);
+	}
+	memcpy((void *)(((UINT)res + 15) & ~15), FPU_STATE(atask), FPU_STATE_SIZE);
+	irq_restore(flags);
+	return res;
+}
+
+void fpu_release(volatile task *atask)
+{
+	if (fpu_owner == atask) fpu_owner = 0;
+	if (atask->fpu_state) kmem_cache_free(fpu_cache, atask->fpu_state);
+	atask->fpu_state = 0;
+}
+
+void setup_fpu(void)
+{
+	UINT eax = 1, ebx, ecx, edx, cr4 = CR4_OSFXSR;
+
+	asm volatile ("cpuid":"+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+	if (!(edx & CPUID_FEAT_FPU)) return;
+	fpu_present = 1;
+	fpu_fxsr = !!(edx & CPUID_FEAT_FXSR);
+	fpu_sse = fpu_fxsr && (edx & CPUID_FEAT_SSE);
+	fpu_cache = kmem_cache_create("fpu_state", FPU_STATE_SIZE + 15);
+	register_interrupt_handler(7, &fpu_trap);
+	if (fpu_sse) cr4 |= CR4_OSXMMEXCPT;
+	if (fpu_fxsr)
+		asm volatile (	"movl %%cr4,%%eax\n\t"
+		                "orl  %0,%%eax\n\t"
+		                "movl %%eax,%%cr4"::"r"(cr4):"eax");
+	asm volatile (	"movl %%cr0,%%eax\n\t"
+	                "andl %0,%%eax\n\t"
+	                "orl  %1,%%eax\n\t"
+	                "movl %%eax,%%cr0"::"i"(~CR0_EM), "i"(CR0_MP | CR0_TS):"eax");
+}
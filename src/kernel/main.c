@@ -21,6 +21,7 @@
 #include <kernel/ktextio.h>
 #include <kernel/nish.h>
 #include <kernel/syscall.h>
+#include <kernel/fpu.h>
 #include <lib/string.h>
 #include <time.h>
 #include <task.h>
@@ -34,9 +35,33 @@ char kernel_cmdline[256] = {0,};
 boot_module boot_modules[NR_BOOT_MODULES];
 UINT boot_modules_count = 0;
 ULONG memory_end = 0;
+mem_region mem_regions[NR_MEM_REGIONS];
+UINT mem_regions_count = 0;
 UINT __working_memstart = 0;
 static UINT initrd_location = 0;
 extern UINT kmalloc_pos;
+extern heap *kheap;
+
+//Only RAM below 4GB, the rest of the map are holes for the frame allocator
+static void read_memory_map(multiboot_info_t* mbd)
+{
+	memory_map_t *entry;
+	UINT pos, start, end;
+
+	for (pos = mbd->mmap_addr; pos < mbd->mmap_addr + mbd->mmap_length; pos += entry->size + sizeof(entry->size)) {
+		entry = (memory_map_t *)pos;
+		if ((entry->type != 1) || entry->base_addr_high) continue;
+		start = entry->base_addr_low;
+		end = start + entry->length_low;
+		if (entry->length_high || (end < start)) end = 0xFFFFFFFF;
+		if (CHECK_ALIGN(start)) start = ALIGN_UP(start);
+		end = ALIGN_DOWN(end);
+		if ((start >= end) || (mem_regions_count >= NR_MEM_REGIONS)) continue;
+		mem_regions[mem_regions_count].start = start;
+		mem_regions[mem_regions_count++].end = end;
+		if (end > memory_end) memory_end = end;
+	}
+}
 
 static void read_multiboot_info(multiboot_info_t* mbd)
 {
@@ -46,8 +71,14 @@ static void read_multiboot_info(multiboot_info_t* mbd)
 	/* According to http://www.gnu.org/software/grub/manual/multiboot/multiboot.html
 	   GRUB can store its values anywhere
 	   I've discovered there are all in the first 640K, but I don't want to risk anything */
-	if (mbd->flags & 0x01) memory_end = mbd->mem_upper * 1024; //TODO: A map would be nicer
-	else memory_end = ASSUMED_WORKING_MEMEND;
+	if (mbd->flags & 0x40) read_memory_map(mbd);
+	if (!mem_regions_count) { //No map, so everything up to the end counts as RAM
+		if (mbd->flags & 0x01) memory_end = (mbd->mem_upper + 1024) * 1024; //mem_upper starts at 1MB
+		else memory_end = ASSUMED_WORKING_MEMEND;
+		mem_regions[0].start = 0;
+		mem_regions[0].end = memory_end;
+		mem_regions_count = 1;
+	}
 	if (mbd->flags & 0x04) {
 		strncpy(kernel_cmdline, (char *)mbd->cmdline, 256);
 		kernel_cmdline[255] = 0;
@@ -64,15 +95,15 @@ static void read_multiboot_info(multiboot_info_t* mbd)
 			memset(boot_modules[i].string, 0, BOOT_MODULE_STRLEN);
 			strncpy(boot_modules[i].string, (char*)mod_infos[i].string, BOOT_MODULE_STRLEN);
 			boot_modules[i].string[BOOT_MODULE_STRLEN-1] = 0;
-			if (*((UINT*)boot_modules[i].addr) == INITRD_MAGIC)
-				initrd_location = boot_modules[i].addr;
+			if (*((UINT*)boot_modules[i].addr) == INITRD_MAGIC) //Still mapped 1:1
+				initrd_location = P2V(boot_modules[i].addr);
 		}
 	}
 	if (boot_modules_count)
 		__working_memstart = boot_modules[boot_modules_count-1].addr + boot_modules[boot_modules_count-1].size;
-	else __working_memstart = (UINT) &kernel_end;
+	else __working_memstart = V2P((UINT) &kernel_end);
 	ASSERT_ALIGN(__working_memstart);
-	kmalloc_pos = WORKING_MEMSTART + IPC_MEMSIZE;
+	kmalloc_pos = P2V(WORKING_MEMSTART + IPC_MEMSIZE);
 }
 
 int init(void)
@@ -93,18 +124,20 @@ int init(void)
 int _kmain(multiboot_info_t* mbd, UINT magic, UINT initial_stack)
 {
 	read_multiboot_info(mbd);
+	setup_memory_functions();
 	initial_esp = initial_stack;
 	_kclear();
-	printf("Nupkux loaded ... Stack at 0x%X\nAmount of RAM: %d Bytes.\nSet up Descriptors ... ", initial_esp, memory_end);
+	printf("Nupkux loaded ... Stack at 0x%X\nAmount of RAM: %u Bytes.\nSet up Descriptors ... ", initial_esp, memory_end);
 	setup_dts();
 	printf("Finished.\nEnable Interrupts and PIC ... ");
 	sti();
 	setup_timer();
-	setup_ACPI();
 	printf("Finished.\nEnable Paging and Memory Manager ... ");
 	setup_paging();
+	setup_ACPI(); //Its tables are found by ioremap
 	printf("Finished.\nSetup Tasking ... ");
 	setup_tasking();
+	setup_fpu();
 	printf("Finished.\nSetup VFS ... ");
 	setup_vfs();
 	printf("Finished.\nMount initrd read-only on root ... ");
@@ -119,7 +152,11 @@ int _kmain(multiboot_info_t* mbd, UINT magic, UINT initial_stack)
 	setup_syscalls();
 	if (nish()) sys_reboot(0x04);
 	init();
-	for (;;) sys_pause();
+	for (;;) { //Idle
+		refill_zero_pool(4);
+		heap_trim(kheap);
+		sys_pause();
+	}
 	return 0;
 }
 
@@ -198,11 +198,16 @@ static int nish_ls(int argc, char *argv[])
 
 static int nish_cd(int argc, char *argv[])
 {
+	char path[STRLEN]; //The syscalls only take user pointers, the stack is one, the heap isn't
+
 	if (argc == 1) {
-		sys_chdir("/");
+		strcpy(path, "/");
+		sys_chdir(path);
 		return 1;
 	}
-	int ret = sys_chdir(argv[1]);
+	strncpy(path, argv[1], STRLEN);
+	path[STRLEN - 1] = 0;
+	int ret = sys_chdir(path);
 	switch (ret) {
 	case -ENOENT:
 		printf("cd: %s: No such file or directory\n", argv[1]);
@@ -230,7 +235,16 @@ static int nish_exec(int argc, char *argv[])
 		printf("CHILDF> Fork PID: %i, parent PID: %i\n", fork_pid, parent_pid);
 		printf("CHILDF> Fork calling execve...\n");
 #endif
-		int process_exit_code = sys_execve(argv[1], (const char **) argv, 0);
+		//sys_execve only takes user pointers, so argv moves from the heap to the stack
+		char strings[4 * STRLEN], *vec[MAX_ARGS], *pos = strings;
+		int i;
+		for (i = 0; i < argc; i++) {
+			if (pos + strlen(argv[i]) + 1 > strings + sizeof(strings)) sys_exit(-E2BIG);
+			vec[i] = strcpy(pos, argv[i]);
+			pos += strlen(pos) + 1;
+		}
+		vec[argc] = 0;
+		int process_exit_code = sys_execve(vec[1], (const char **) vec, 0);
 		// any point below here should never be reached, 'cause any process in sys_execve should call sys_exit(...);.
 		// anyhow, this is not happening (yet). also, the following code assures, that the exit code is set
 		// correctly if sys_execve fails due to permission restrictions, etc.
@@ -17,31 +17,192 @@
  *  along with Nupkux.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+/*
+ * Every priority has its own run queue, a bit in run_bitmap tells which ones
+ * are non-empty. Picking the next task is a bsf and a list head, independent
+ * of the number of tasks. Blocked tasks wait on their own list until
+ * wake_up_task() puts them back. The queues are circular, so head->run_prev
+ * is the tail.
+ *
+ * Wait queues sit on top of that: sleep_on() blocks the current task on a
+ * queue until wake_up() puts all of its tasks back on the run queues. Nothing
+ * is polled, a task that waits costs the scheduler nothing.
+ */
+
 #include <task.h>
 
-extern volatile task tasks[NR_TASKS];
+static volatile task *run_queue[NR_PRIORITIES] = {0,};
+static volatile task *blocked_tasks = 0;
+static UINT run_bitmap = 0;
+
+static UINT sched_lowest_bit(UINT value)
+{
+	UINT res;
+
+	asm ("bsfl %1,%0":"=r"(res):"rm"(value));
+	return res;
+}
+
+static void task_list_add(volatile task **list, volatile task *atask)
+{
+	if (!*list) {
+		atask->run_next = atask->run_prev = atask;
+		*list = atask;
+		return;
+	}
+	atask->run_next = *list;
+	atask->run_prev = (*list)->run_prev;
+	(*list)->run_prev->run_next = atask;
+	(*list)->run_prev = atask;
+}
+
+static void task_list_del(volatile task **list, volatile task *atask)
+{
+	if (atask->run_next == atask) *list = 0;
+	else {
+		atask->run_prev->run_next = atask->run_next;
+		atask->run_next->run_prev = atask->run_prev;
+		if (*list == atask) *list = atask->run_next;
+	}
+	atask->run_next = atask->run_prev = 0;
+}
+
+static void enqueue_task(volatile task *atask, int prio)
+{
+	if (atask->time_slice <= 0) atask->time_slice = SCHED_SLICE(atask->priority);
+	atask->run_prio = prio;
+	atask->state = TASK_WAITING;
+	task_list_add(&run_queue[prio], atask);
+	run_bitmap |= 1 << prio;
+}
+
+static void dequeue_task(volatile task *atask)
+{
+	task_list_del(&run_queue[(int)atask->run_prio], atask);
+	if (!run_queue[(int)atask->run_prio]) run_bitmap &= ~(1 << atask->run_prio);
+}
+
+void sched_add_task(volatile task *atask)
+{
+	UINT flags;
+
+	irq_save(flags);
+	atask->time_slice = 0;
+	enqueue_task(atask, atask->priority);
+	timer_resched();
+	irq_restore(flags);
+}
+
+//prio may only boost the task for its next slice, it falls back to its own priority afterwards
+void wake_up_task(volatile task *atask, int prio)
+{
+	UINT flags;
+
+	if (prio > atask->priority) prio = atask->priority;
+	irq_save(flags);
+	if (atask->state == TASK_BLOCKED) {
+		task_list_del(&blocked_tasks, atask);
+		enqueue_task(atask, prio);
+		timer_resched();
+	} else if (atask->state == TASK_WAITING && prio < atask->run_prio) {
+		dequeue_task(atask);
+		enqueue_task(atask, prio);
+	}
+	irq_restore(flags);
+}
+
+//Time slicing is only needed while somebody else is ready
+int sched_need_tick(void)
+{
+	return run_bitmap != 0;
+}
+
+//Called by the scheduler tick, tells if the current task has to give up the CPU
+int sched_tick(void)
+{
+	if (!current_task) return 0;
+	if (current_task->run_prio == PRIO_IDLE) return run_bitmap != 0;
+	if (--current_task->time_slice <= 0) return 1;
+	return run_bitmap && sched_lowest_bit(run_bitmap) < (UINT)current_task->run_prio;
+}
+
+//The kernel task is run when nobody is ready, halt until the next interrupt then
+static void idle_halt(void)
+{
+	if (current_task->run_prio == PRIO_IDLE) asm volatile ("sti\n\thlt\n\tcli");
+}
 
 volatile task* schedule(void)
 {
-	pid_t i;
-	volatile task *new_task = current_task;
-	for (i = NR_TASKS; i >= 0; i--) {
-		if (tasks[i].pid != NO_TASK && tasks[i].signals && tasks[i].state == TASK_BLOCKED)
-			tasks[i].state = TASK_WAITING;
+	volatile task *prev = current_task, *next;
+
+	if (prev->state == TASK_RUNNING) enqueue_task(prev, prev->priority);
+	else if (prev->state == TASK_BLOCKED) task_list_add(&blocked_tasks, prev);
+	if (!run_bitmap) {
+		next = kernel_task; //This runs the kernel task, even if it's paused
+		if (next->state == TASK_BLOCKED) task_list_del(&blocked_tasks, next);
+		next->run_prio = PRIO_IDLE;
+		return next;
 	}
+	next = run_queue[sched_lowest_bit(run_bitmap)];
+	dequeue_task(next);
+	return next;
+}
+
+static void wait_queue_del(wait_queue *queue, volatile task *atask)
+{
+	volatile task * volatile *p = &queue->first;
 
-	for (i = new_task->pid + 1; i < NR_TASKS; i++)
-		if (tasks[i].pid != NO_TASK && tasks[i].state == TASK_WAITING) break;
-	if (i == NR_TASKS) {
-		new_task = tasks; //This runs the kernel task, even if it's paused
-	} else new_task = &(tasks[i]);
-	return new_task;
+	while (*p && *p != atask) p = &(*p)->wait_next;
+	if (*p) *p = atask->wait_next;
+	atask->wait_next = 0;
+	atask->wait_on = 0;
 }
 
-int sys_pause(void)
+//Returns with interrupts disabled, see wait_event()
+void sleep_on(wait_queue *queue)
 {
+	volatile task * volatile *p = &queue->first;
+
+	cli();
+	while (*p) p = &(*p)->wait_next;
+	*p = current_task;
+	current_task->wait_next = 0;
+	current_task->wait_on = queue;
 	current_task->state = TASK_BLOCKED;
 	switch_task();
-	return 0;
+	cli();
+	if (current_task->wait_on) wait_queue_del(current_task->wait_on, current_task); //Signaled or run as idle task
+	idle_halt();
+}
+
+void wake_up_prio(wait_queue *queue, int prio)
+{
+	volatile task *atask;
+	UINT flags;
+
+	irq_save(flags);
+	while ((atask = queue->first)) {
+		queue->first = atask->wait_next;
+		atask->wait_next = 0;
+		atask->wait_on = 0;
+		wake_up_task(atask, prio);
+	}
+	irq_restore(flags);
 }
 
+int sys_pause(void)
+{
+	UINT flags;
+
+	irq_save(flags);
+	if (!current_task->signals) {
+		current_task->state = TASK_BLOCKED;
+		switch_task();
+		cli();
+		idle_halt();
+	}
+	current_task->signals = 0; //There are no handlers, pause() consumes what woke it
+	irq_restore(flags);
+	return 0;
+}
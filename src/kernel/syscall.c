@@ -83,6 +83,10 @@ void setup_syscalls()
 	sys_call_table[__NR_getppid] = &sys_getppid;
 	sys_call_table[__NR_dup2] = &sys_dup2;
 	sys_call_table[__NR_reboot] = &sys_reboot;
+	sys_call_table[__NR_brk] = &sys_brk;
+	sys_call_table[__NR_mmap] = &sys_mmap;
+	sys_call_table[__NR_munmap] = &sys_munmap;
+	sys_call_table[__NR_nanosleep] = &sys_nanosleep;
 
 	register_interrupt_handler(0x80, &SysCallHandler);
 }
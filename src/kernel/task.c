@@ -22,12 +22,22 @@
 #include <kernel/dts.h>
 #include <errno.h>
 #include <kernel/syscall.h>
+#include <kernel/fpu.h>
 
 volatile task *current_task = 0;
-volatile task tasks[NR_TASKS];
+volatile task *kernel_task = 0;
+volatile task *task_list = 0;	//All tasks, zombies included
+UINT nr_tasks = 0;
+kmem_pool kstack_pool;
+
+static volatile task *pid_hash[PID_HASH_SIZE] = {0,};
+static kmem_cache *task_cache = 0;
+static pid_t next_pid = 1;
+//A dying task runs on its stack and directory until it is switched away, the next task frees them
+static page_directory *dead_directory = 0;
+static UINT dead_kernel_stack = 0;
 
 extern page_directory *kernel_directory; //paging.c
-extern UINT _kmalloc_a(UINT sz); //mm.c
 
 extern volatile task* schedule(void);	//sched.c
 extern UINT read_eip(void);		//process.S
@@ -37,16 +47,15 @@ void move_stack(void *new_stack, UINT size)
 {
 	UINT i, old_esp, old_ebp, new_esp, new_ebp, tmp, offset;
 
-	for (i = (UINT)new_stack; i >= ((UINT)new_stack - size); i -= FRAME_SIZE)
-		make_page(i, PAGE_FLAG_PRESENT | PAGE_FLAG_WRITE | PAGE_FLAG_USERMODE, current_directory, 1);
-	flush_tlb();
+	for (i = (UINT)new_stack - FRAME_SIZE; i >= ((UINT)new_stack - size); i -= FRAME_SIZE)
+		make_page(i, PAGE_FLAG_PRESENT | PAGE_FLAG_WRITE | PAGE_FLAG_USERMODE | PAGE_FLAG_STACK, current_directory, 1);
 	asm volatile (	"movl %%esp,%0\n\t"
 	                "movl %%ebp,%1\n\t":"=r"(old_esp), "=r"(old_ebp));
 	offset = (UINT)new_stack - initial_esp;
 	new_esp = old_esp + offset;
 	new_ebp = old_ebp + offset;
 	memcpy((void *)new_esp, (void*)old_esp, initial_esp - old_esp);
-	for (i = (UINT)new_stack; i > (UINT)new_stack - size; i -= sizeof(UINT)) {
+	for (i = (UINT)new_stack - sizeof(UINT); i >= (UINT)new_stack - size; i -= sizeof(UINT)) {
 		tmp = *(UINT *)i;
 		if ((old_esp < tmp) && (tmp < initial_esp))
 			*((UINT *)i) = tmp + offset;
@@ -55,21 +64,124 @@ void move_stack(void *new_stack, UINT size)
 	                "movl %1,%%ebp\n\t"::"r"(new_esp), "r"(new_ebp));
 }
 
+volatile task *find_task(pid_t pid)
+{
+	volatile task *atask;
+
+	if (pid < 0) return 0;
+	for (atask = pid_hash[PID_HASH(pid)]; atask; atask = atask->hash_next)
+		if (atask->pid == pid) return atask;
+	return 0;
+}
+
+static pid_t alloc_pid(void)
+{
+	pid_t pid;
+
+	do {
+		pid = next_pid++;
+		if (next_pid >= PID_MAX) next_pid = 1;
+	} while (find_task(pid));
+	return pid;
+}
+
+static void link_task(volatile task *atask, volatile task *parent)
+{
+	volatile task **bucket = &pid_hash[PID_HASH(atask->pid)];
+
+	atask->hash_next = *bucket;
+	*bucket = atask;
+	atask->all_prev = 0;
+	atask->all_next = task_list;
+	if (task_list) task_list->all_prev = atask;
+	task_list = atask;
+	atask->children = 0;
+	atask->sibling_prev = 0;
+	atask->sibling_next = 0;
+	if (parent) {
+		atask->sibling_next = parent->children;
+		if (parent->children) parent->children->sibling_prev = atask;
+		parent->children = atask;
+	}
+	nr_tasks++;
+}
+
+static void unlink_sibling(volatile task *atask)
+{
+	volatile task *parent = find_task(atask->parent);
+
+	if (atask->sibling_prev) atask->sibling_prev->sibling_next = atask->sibling_next;
+	else if (parent && parent->children == atask) parent->children = atask->sibling_next;
+	if (atask->sibling_next) atask->sibling_next->sibling_prev = atask->sibling_prev;
+	atask->sibling_next = atask->sibling_prev = 0;
+}
+
+//INIT inherits the orphans, or the kernel task if there is no INIT
+void reparent_children(volatile task *atask)
+{
+	volatile task *reaper = find_task(1), *child;
+
+	if (!reaper || reaper == atask) reaper = kernel_task;
+	while ((child = atask->children)) {
+		atask->children = child->sibling_next;
+		child->parent = reaper->pid;
+		child->sibling_prev = 0;
+		child->sibling_next = reaper->children;
+		if (reaper->children) reaper->children->sibling_prev = child;
+		reaper->children = child;
+	}
+}
+
+//Frees a reaped zombie
+void release_task(volatile task *atask)
+{
+	volatile task * volatile *p = &pid_hash[PID_HASH(atask->pid)];
+	UINT flags;
+
+	irq_save(flags);
+	while (*p && *p != atask) p = &(*p)->hash_next;
+	if (*p) *p = atask->hash_next;
+	if (atask->all_prev) atask->all_prev->all_next = atask->all_next;
+	else task_list = atask->all_next;
+	if (atask->all_next) atask->all_next->all_prev = atask->all_prev;
+	unlink_sibling(atask);
+	nr_tasks--;
+	atask->pid = NO_TASK;
+	kmem_cache_free(task_cache, (void *)atask);
+	irq_restore(flags);
+}
+
+void free_task_memory(volatile task *atask)
+{
+	dead_directory = atask->directory;
+	dead_kernel_stack = atask->kernel_stack;
+}
+
+//Interrupts are off, the dying task is gone from the CPU
+static void free_dead_memory(void)
+{
+	if (dead_directory) free_directory(dead_directory);
+	if (dead_kernel_stack) kmem_pool_free(&kstack_pool, (void *)dead_kernel_stack);
+	dead_directory = 0;
+	dead_kernel_stack = 0;
+}
+
 void setup_tasking()
 {
 	cli();
-	move_stack((void*)0xE0000000, 0x2000);
-	UINT i;
-	for (i = 1; i < NR_TASKS; i++)
-		tasks[i].pid = NO_TASK;
-	current_task = tasks;
-	current_task->pid = 0;;
+	move_stack((void*)BOOT_STACK_TOP, BOOT_STACK_SIZE);
+	task_cache = kmem_cache_create("task", sizeof(task));
+	kernel_task = current_task = kmem_cache_zalloc(task_cache);
+	current_task->pid = 0;
 	current_task->pgrp = 0;
 	current_task->parent = 0;
 	current_task->esp = current_task->ebp = 0;
 	current_task->eip = 0;
 	current_task->state = TASK_RUNNING;
+	current_task->priority = current_task->run_prio = PRIO_DEFAULT;
+	current_task->time_slice = SCHED_SLICE(PRIO_DEFAULT);
 	current_task->directory = current_directory;
+	current_task->vmas = 0;
 	current_task->gid = ROOT_UID; //root runs it
 	current_task->egid = ROOT_UID;
 	current_task->uid = ROOT_UID;
@@ -79,7 +191,9 @@ void setup_tasking()
 	current_task->signals = 0;
 	current_task->close_on_exec = 0;
 	memset((void *)(current_task->files), 0, sizeof(FILE *)*NR_OPEN);
-	current_task->kernel_stack = _kmalloc_a(KERNEL_STACK_SIZE);
+	kmem_pool_init(&kstack_pool, "kernel_stack", KERNEL_STACK_SIZE, 8);
+	current_task->kernel_stack = (UINT)kmem_pool_alloc(&kstack_pool, 0);
+	link_task(current_task, 0);
 	sti();
 }
 
@@ -91,21 +205,27 @@ void switch_task()
 	asm volatile (	"movl %%esp,%0\n\t"
 	                "movl %%ebp,%1\n\t":"=r"(esp), "=r"(ebp));
 	if ((eip = read_eip()) == 0x2DF) {
+		free_dead_memory();
 		sti();
 		return; //Just switched
 	}
 	current_task->eip = eip;
 	current_task->esp = esp;
 	current_task->ebp = ebp;
-	if (current_task->state == TASK_RUNNING)
-		current_task->state = TASK_WAITING;
 	current_task = schedule();
+	fpu_switch(current_task);
 	current_task->state = TASK_RUNNING;
 	eip = current_task->eip;
 	esp = current_task->esp;
 	ebp = current_task->ebp;
-	current_directory = current_task->directory;
 	set_kernel_stack(current_task->kernel_stack + KERNEL_STACK_SIZE);
+	if (current_directory == current_task->directory) //Keep the TLB
+		asm volatile(	"movl %0,%%ecx\n\t"
+		                "movl %1,%%esp\n\t"
+		                "movl %2,%%ebp\n\t"
+		                "movl $0x2DF,%%eax\n\t"
+		                "jmp *%%ecx\n\t"::"r"(eip), "r"(esp), "r"(ebp));
+	current_directory = current_task->directory;
 	asm volatile(	"movl %0,%%ecx\n\t"
 	                "movl %1,%%esp\n\t"
 	                "movl %2,%%ebp\n\t"
@@ -117,30 +237,42 @@ void switch_task()
 pid_t sys_fork()
 {
 	cli();
-	volatile task *parent_task = current_task;
-	pid_t i;
-	for (i = 0; i < NR_TASKS; i++)
-		if (tasks[i].pid == NO_TASK) break;
-	if (i == NR_TASKS) return -1;
+	volatile task *parent_task = current_task, *newtask;
+	void *fpu_state = 0;
+	int i;
+	if (nr_tasks >= TASK_MAX || !(newtask = kmem_cache_alloc(task_cache))) {
+		sti();
+		return -EAGAIN;
+	}
+	if (parent_task->fpu_state && !(fpu_state = fpu_copy(parent_task))) {
+		kmem_cache_free(task_cache, (void *)newtask);
+		sti();
+		return -EAGAIN;
+	}
 	page_directory *directory = clone_directory(current_directory);
-	volatile task *newtask = (&(tasks[i]));
+	flush_tlb(); //Our pages became read-only
 	*newtask = *parent_task;
-	newtask->pid = i;
+	newtask->pid = alloc_pid();
+	newtask->fpu_state = fpu_state;
+	link_task(newtask, parent_task);
 	newtask->esp = 0;
 	newtask->ebp = 0;
 	newtask->eip = 0;
 	newtask->exit_code = 0;
-	newtask->state = TASK_WAITING;
 	newtask->parent = parent_task->pid;
 	newtask->directory = directory;
+	newtask->vmas = vma_clone(parent_task->vmas);
 	newtask->signals = 0;
+	newtask->wait_next = 0;
+	newtask->wait_on = 0;
+	newtask->wait_exit.first = 0;
 	for (i = NR_OPEN; i--;) {
 		if (newtask->files[i])
 			newtask->files[i]->count++;
 	}
 	if (current_task->pwd) current_task->pwd->count++;
 	if (current_task->root) current_task->root->count++;
-	current_task->kernel_stack = _kmalloc_a(KERNEL_STACK_SIZE);
+	current_task->kernel_stack = (UINT)kmem_pool_alloc(&kstack_pool, 0);
 	UINT eip = read_eip();
 	if (current_task == parent_task) {
 		UINT esp, ebp;
@@ -149,9 +281,11 @@ pid_t sys_fork()
 		newtask->esp = esp;
 		newtask->ebp = ebp;
 		newtask->eip = eip;
+		sched_add_task(newtask);
 		sti();
 		return newtask->pid;
 	} else {
+		free_dead_memory();
 		sti();
 		return 0;
 	}
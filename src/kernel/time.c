@@ -21,32 +21,141 @@
 #include <drivers/drivers.h>
 #include <kernel/dts.h>
 #include <task.h>
+#include <errno.h>
 
-#define tick_rate 50
+/*
+ * The PIT runs in one-shot mode (mode 0) and is programmed for the next
+ * timer that expires, at most PIT_MAX cycles ahead to keep the clock going.
+ * There is no periodic tick: the scheduler tick is just another timer, armed
+ * only while more than one task wants the CPU. An idle system wakes up 18
+ * times a second to account the time and nothing else.
+ */
+
+#define tick_rate	50	//Scheduler ticks per second, while tasks compete
+#define TICK_CYCLES	(PIT_HZ / tick_rate)
+#define PIT_MAX		0xFFFF
 
 static int _ktimezone = 1;
 static int _kdaylight_saving_time = 1; //It's the 27th of July
 
-ULONG ticks = 0;
+static ULLONG clock = 0;	//PIT cycles up to the last programming of the PIT
+static UINT pit_count = 0;	//Cycles it was programmed with
+static timer *timers = 0;	//Sorted by expires
+static timer sched_timer;
+static UCHAR resched = 0;
+
+static void pit_oneshot(UINT count)
+{
+	outportb(0x43, 0x30);
+	outportb(0x40, count & 0xFF);
+	outportb(0x40, (count >> 8) & 0xFF);
+	pit_count = count;
+}
+
+//Cycles since pit_oneshot()
+static UINT pit_elapsed(void)
+{
+	UINT left;
+
+	if (!pit_count) return 0;
+	outportb(0x43, 0xE2); //Read-back the status of channel 0
+	if (inportb(0x40) & 0x80) return pit_count; //OUT is high, it went past zero
+	outportb(0x43, 0x00); //Latch the count
+	left = inportb(0x40);
+	left |= inportb(0x40) << 8;
+	if (left > pit_count) return pit_count;
+	return pit_count - left;
+}
+
+ULLONG clock_cycles(void)
+{
+	ULLONG now;
+	UINT flags;
+
+	irq_save(flags);
+	now = clock + pit_elapsed();
+	irq_restore(flags);
+	return now;
+}
+
+//Interrupts must be off
+static void timer_program(void)
+{
+	ULLONG delta = PIT_MAX;
 
-static void set_pic_timer(int freq)
+	clock += pit_elapsed();
+	if (timers) {
+		if (timers->expires <= clock) delta = 1;
+		else if (timers->expires - clock < PIT_MAX) delta = timers->expires - clock;
+	}
+	pit_oneshot(delta);
+}
+
+void add_timer(timer *atimer)
 {
-	int divisor = 1193180 / freq;
-	outportb(0x43, 0x36);
-	outportb(0x40, divisor & 0xFF);
-	outportb(0x40, (divisor >> 8) & 0xFF);
+	timer **p = &timers;
+	UINT flags;
+
+	irq_save(flags);
+	while (*p && (*p)->expires <= atimer->expires) p = &(*p)->next;
+	atimer->next = *p;
+	*p = atimer;
+	atimer->pending = 1;
+	if (timers == atimer) timer_program();
+	irq_restore(flags);
+}
+
+void timer_wake(void *queue)
+{
+	wake_up((wait_queue *)queue);
+}
+
+static void sched_timer_func(void *data)
+{
+	if (sched_tick()) resched = 1;
+	if (sched_need_tick()) {
+		sched_timer.expires += TICK_CYCLES;
+		add_timer(&sched_timer);
+	}
+}
+
+//A task became ready, start slicing if that's not running already
+void timer_resched(void)
+{
+	UINT flags;
+
+	irq_save(flags);
+	if (!sched_timer.pending) {
+		sched_timer.expires = clock + pit_elapsed() + TICK_CYCLES;
+		add_timer(&sched_timer);
+	}
+	irq_restore(flags);
 }
 
 void timer_handler(registers *regs)
 {
-	ticks++;
-	switch_task();
+	timer *atimer;
+
+	clock += pit_elapsed(); //Not pit_count, the interrupt may be older than the last pit_oneshot()
+	pit_count = 0;
+	while ((atimer = timers) && atimer->expires <= clock) {
+		timers = atimer->next;
+		atimer->pending = 0;
+		atimer->func(atimer->data);
+	}
+	timer_program();
+	if (resched) {
+		resched = 0;
+		switch_task();
+	}
 }
 
 void setup_timer()
 {
-	set_pic_timer(tick_rate);
+	sched_timer.func = sched_timer_func;
+	sched_timer.data = 0;
 	register_interrupt_handler(IRQ0, &timer_handler);
+	pit_oneshot(PIT_MAX);
 }
 
 static UCHAR DateBCD(UCHAR value, int is_bcd)
@@ -140,10 +249,42 @@ time_t time(time_t *tp)
 	return result;
 }
 
+//Sleeps for at least cycles, other tasks run meanwhile
+static void sleep_cycles(ULLONG cycles)
+{
+	ULLONG end = clock_cycles() + cycles;
+	timer *atimer;
+
+	if (!current_task) { //Too early to sleep
+		while (clock_cycles() < end);
+		return;
+	}
+	atimer = (timer *)&current_task->sleep_timer; //Not on the stack, that's per process
+	atimer->expires = end;
+	atimer->func = timer_wake;
+	atimer->data = (void *)&current_task->wait_sleep;
+	add_timer(atimer);
+	wait_event((wait_queue *)&current_task->wait_sleep, !atimer->pending);
+}
+
 void sleep(UINT msecs)
 {
-	ULONG tstart = ticks, tdiff = (tick_rate * msecs) / 1000;
-	while (ticks - tdiff < tstart);
+	sleep_cycles((ULLONG)msecs * (PIT_HZ / 1000) + 1);
+}
+
+int sys_nanosleep(const struct timespec *req, struct timespec *rem)
+{
+	struct timespec ts;
+
+	if (copy_from_user(&ts, req, sizeof(struct timespec))) return -EFAULT;
+	if (ts.tv_sec < 0 || ts.tv_nsec < 0 || ts.tv_nsec >= NSEC_PER_SEC) return -EINVAL;
+	//nsec * PIT_HZ / NSEC_PER_SEC without a 64 bit division, 5124677 = 2^32 * PIT_HZ / NSEC_PER_SEC
+	sleep_cycles((ULLONG)ts.tv_sec * PIT_HZ + (((ULLONG)ts.tv_nsec * 5124677) >> 32) + 1);
+	if (rem) {
+		ts.tv_sec = ts.tv_nsec = 0; //Signals don't interrupt it
+		if (copy_to_user(rem, &ts, sizeof(struct timespec))) return -EFAULT;
+	}
+	return 0;
 }
 
 int removetimezone(struct tm *timeptr)
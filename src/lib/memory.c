@@ -19,39 +19,105 @@
 
 #include <lib/memory.h>
 
+/*
+ * With ERMS (CPUID 7, EBX bit 9) a single rep movsb/stosb is the fastest way
+ * at any size and alignment. Older CPUs move dwords once the destination is
+ * aligned and do the rest bytewise, small counts go bytewise only.
+ */
+
+#define CPUID_FEAT_ERMS	0x200
+
+UCHAR mem_fast_strings = 0;
+
+void setup_memory_functions(void)
+{
+	UINT eax = 0, ebx, ecx = 0, edx;
+
+	asm volatile ("cpuid":"+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+	if (eax < 7) return;
+	eax = 7;
+	ecx = 0;
+	asm volatile ("cpuid":"+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+	mem_fast_strings = !!(ebx & CPUID_FEAT_ERMS);
+}
+
 void *memcpy(void *target, const void *src, size_t count)
 {
-	char *tmp = (char *) target, *source = (char *)src;
-	while (count--) {
-		*tmp = *source;
-		tmp++;
-		source++;
+	UINT head = (-(UINT)target) & 3;
+	int d0, d1, d2;
+
+	if (mem_fast_strings || (count < 16)) {
+		asm volatile (	"rep movsb"
+		                :"=&c"(d0), "=&D"(d1), "=&S"(d2)
+		                :"0"(count), "1"(target), "2"(src)
+		                :"memory");
+		return target;
 	}
+	asm volatile (	"rep movsb\n\t"
+	                "movl %4,%%ecx\n\t"
+	                "rep movsl\n\t"
+	                "movl %5,%%ecx\n\t"
+	                "rep movsb"
+	                :"=&c"(d0), "=&D"(d1), "=&S"(d2)
+	                :"0"(head), "g"((count - head) / 4), "g"((count - head) & 3), "1"(target), "2"(src)
+	                :"memory");
 	return target;
 }
 
 void *memset(void *target, int value, size_t count)
 {
-	char *tmp = (char *)target;
-	while (count--) *(tmp++) = value;
+	UINT head = (-(UINT)target) & 3;
+	int d0, d1;
+
+	if (mem_fast_strings || (count < 16)) {
+		asm volatile (	"rep stosb"
+		                :"=&c"(d0), "=&D"(d1)
+		                :"a"(value), "0"(count), "1"(target)
+		                :"memory");
+		return target;
+	}
+	asm volatile (	"rep stosb\n\t"
+	                "movl %3,%%ecx\n\t"
+	                "rep stosl\n\t"
+	                "movl %4,%%ecx\n\t"
+	                "rep stosb"
+	                :"=&c"(d0), "=&D"(d1)
+	                :"a"((UCHAR)value * 0x01010101), "g"((count - head) / 4), "g"((count - head) & 3), "0"(head), "1"(target)
+	                :"memory");
 	return target;
 }
 
 USHORT *memsetw(USHORT *target, int value, size_t count)
 {
-	USHORT *tmp = target;
-	while (count --) *(tmp++) = value;
+	UINT fill = (USHORT)value * 0x00010001;
+	int d0, d1;
+
+	if (((UINT)target & 2) && count) {
+		*target = value;
+		return memsetw(target + 1, value, count - 1) - 1;
+	}
+	asm volatile (	"rep stosl\n\t"
+	                "movl %3,%%ecx\n\t"
+	                "rep stosw"
+	                :"=&c"(d0), "=&D"(d1)
+	                :"a"(fill), "g"(count & 1), "0"(count / 2), "1"(target)
+	                :"memory");
 	return target;
 }
 
 int memcmp(const void *s1, const void *s2, size_t n)
 {
-	if (n) {
-		register const UCHAR *p1 = s1, *p2 = s2;
-		do {
-			if (*p1++ != *p2++)
-				return (*--p1 - *--p2);
-		} while (--n);
+	const UINT *w1 = s1, *w2 = s2;
+	const UCHAR *p1, *p2;
+
+	while ((n >= 4) && (*w1 == *w2)) {
+		w1++;
+		w2++;
+		n -= 4;
 	}
+	p1 = (const UCHAR *)w1;
+	p2 = (const UCHAR *)w2;
+	for (; n; n--, p1++, p2++)
+		if (*p1 != *p2) return *p1 - *p2;
 	return 0;
 }
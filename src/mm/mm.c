@@ -22,8 +22,22 @@
 UINT kmalloc_pos;
 heap *kheap = 0;
 
+#ifdef MM_TRACE_CALLERS
+mm_caller mm_callers[MM_NR_CALLERS];
+#endif
+
 static void *heap_malloc(UINT size, UCHAR page_align, heap *aheap);
 
+#ifdef MM_TRACE_CALLERS
+static void mm_trace_alloc(void *ptr, UINT caller);
+#define TRACE_ALLOC(PTR, CALLER) mm_trace_alloc(PTR, CALLER)
+#define TRACE_FREE(PTR) mm_trace_free(PTR)
+#define CALLER() ((UINT)__builtin_return_address(0))
+#else
+#define TRACE_ALLOC(PTR, CALLER)
+#define TRACE_FREE(PTR)
+#endif
+
 extern page_directory *kernel_directory;
 
 static UINT _kmalloc_base(UINT sz, UINT *phys, UCHAR align)
@@ -32,13 +46,14 @@ static UINT _kmalloc_base(UINT sz, UINT *phys, UCHAR align)
 
 	if (kheap) {
 		res = (UINT)heap_malloc(sz, align, kheap);
+		TRACE_ALLOC((void *)res, 0);
 		if (phys) {
 			page *apage = get_page(res, 0, kernel_directory);
 			*phys = (apage->frame * FRAME_SIZE) + (res & 0xFFF);
 		}
 	} else {
 		if (align) ASSERT_ALIGN(kmalloc_pos);
-		if (phys) *phys = kmalloc_pos;
+		if (phys) *phys = V2P(kmalloc_pos);
 		res = kmalloc_pos;
 		kmalloc_pos += sz;
 	}
@@ -60,286 +75,406 @@ UINT _kmalloc_pa(UINT sz, UINT *phys)
 	return _kmalloc_base(sz, phys, 1);
 }
 
+static UINT mm_log2(UINT value)
+{
+	UINT res;
+
+	asm ("bsrl %1,%0":"=r"(res):"rm"(value));
+	return res;
+}
+
+static UINT mm_lowest_bit(UINT value)
+{
+	UINT res;
+
+	asm ("bsfl %1,%0":"=r"(res):"rm"(value));
+	return res;
+}
+
+static UINT heap_block_size(UINT size)
+{
+	size = (size + sizeof(mm_header) + sizeof(mm_footer) + MM_ALIGN - 1) & ~(MM_ALIGN - 1);
+	return (size < MM_MIN_BLOCK) ? MM_MIN_BLOCK : size;
+}
+
+static void mm_set_block(UINT pos, UINT size, UCHAR flag)
+{
+	mm_header *header = (mm_header *)pos;
+	mm_footer *footer = (mm_footer *)(pos + size - sizeof(mm_footer));
+
+	header->magic = footer->magic = MM_MAGIC;
+	header->size = size;
+	header->flag = flag;
+	footer->header = header;
+}
+
+static void heap_add_hole(mm_hole *hole, heap *aheap)
+{
+	UINT i = mm_log2(hole->header.size);
+
+	hole->prev = 0;
+	hole->next = aheap->buckets[i];
+	if (hole->next) hole->next->prev = hole;
+	aheap->buckets[i] = hole;
+	aheap->bucketmap |= 1 << i;
+	aheap->holes++;
+}
+
+static void heap_del_hole(mm_hole *hole, heap *aheap)
+{
+	UINT i = mm_log2(hole->header.size);
+
+	if (hole->prev) hole->prev->next = hole->next;
+	else if (!(aheap->buckets[i] = hole->next)) aheap->bucketmap &= ~(1 << i);
+	if (hole->next) hole->next->prev = hole->prev;
+	aheap->holes--;
+}
+
 heap *create_heap(UINT start, UINT end, UINT memend, UINT pageflags)
 {
 	heap *newheap = (heap *)_kmalloc(sizeof(heap));
-	mm_header *initholestart;
-	mm_footer *initholeend;
 
 	ASSERT_ALIGN(start);
 	ASSERT_ALIGN(end);
 	ASSERT_ALIGN(memend);
-	newheap->entries = (mm_header **)start;
-	start += MM_INDEX_COUNT * sizeof(mm_header *);
-	ASSERT_ALIGN(start);
+	memset(newheap, 0, sizeof(heap));
 	newheap->start = start;
 	newheap->end = end;
 	newheap->memend = memend;
 	newheap->pageflags = pageflags;
-
-	initholestart = (mm_header *) start;
-	initholestart->magic = MM_MAGIC;
-	initholestart->size = end - start;
-	initholestart->flag = MM_FLAG_HOLE;
-	newheap->entries[0] = initholestart;
-
-	initholeend = (mm_footer *) (end - sizeof(mm_footer));
-	initholeend->magic = MM_MAGIC;
-	initholeend->header = newheap->entries[0];
-
-	newheap->entrycount = 1;
-	newheap->maxentries = MM_INDEX_COUNT;
-
+	mm_set_block(start, end - start, MM_FLAG_HOLE);
+	heap_add_hole((mm_hole *)start, newheap);
 	return newheap;
 }
 
-static void expand_heap(UINT new_size, heap *aheap)
+//Makes sure there is a hole of at least size Bytes at the end of the heap
+static UINT expand_heap(UINT size, heap *aheap)
 {
-	UINT i;
-
-	if (new_size <= aheap->end - aheap->start) return;
-	ASSERT_ALIGN(new_size);
-	if (aheap->start + new_size > aheap->memend) return;
-	for (i = aheap->end - aheap->start; i < new_size; i += FRAME_SIZE)
-		make_page(aheap->start + i, aheap->pageflags, kernel_directory, 1);
-	aheap->end = aheap->start + new_size;
+	mm_footer *footer = (mm_footer *)(aheap->end - sizeof(mm_footer));
+	UINT pos = aheap->end, end, i;
+
+	if ((aheap->end > aheap->start) && (footer->header->flag == MM_FLAG_HOLE))
+		pos = (UINT)footer->header;
+	end = pos + size;
+	if (CHECK_ALIGN(end)) end = ALIGN_UP(end);
+	if ((end < pos) || (end > aheap->memend)) return 0;
+	for (i = aheap->end; i < end; i += FRAME_SIZE)
+		make_page(i, aheap->pageflags, kernel_directory, 1);
+	if (pos != aheap->end) heap_del_hole((mm_hole *)pos, aheap);
+	aheap->pages_mapped += (end - aheap->end) / FRAME_SIZE;
+	aheap->end = end;
+	aheap->expands++;
+	mm_set_block(pos, end - pos, MM_FLAG_HOLE);
+	heap_add_hole((mm_hole *)pos, aheap);
+	return 1;
 }
 
-static UINT contract_heap(UINT new_size, heap *aheap)
+//Gives back the pages of a hole at the end of the heap, keep Bytes of it stay
+static UINT contract_heap(mm_hole *hole, UINT keep, heap *aheap)
 {
-	UINT i;
+	UINT pos = (UINT)hole, end = pos + keep, i;
+
+	if (CHECK_ALIGN(end)) end = ALIGN_UP(end);
+	if (end < aheap->start + MM_KHEAP_MIN) end = aheap->start + MM_KHEAP_MIN;
+	//After the floor, the remaining hole must still hold its header and footer
+	if ((end > pos) && (end - pos < MM_MIN_BLOCK)) end += FRAME_SIZE;
+	if (end >= aheap->end) return 0;
+	heap_del_hole(hole, aheap);
+	for (i = end; i < aheap->end; i += FRAME_SIZE)
+		free_page(i, kernel_directory);
+	aheap->pages_unmapped += (aheap->end - end) / FRAME_SIZE;
+	aheap->end = end;
+	aheap->contracts++;
+	if (end == pos) return 1;
+	mm_set_block(pos, end - pos, MM_FLAG_HOLE);
+	heap_add_hole(hole, aheap);
+	return 1;
+}
 
-	if (new_size >= aheap->end - aheap->start) return aheap->end - aheap->start;
-	ASSERT_ALIGN(new_size);
-	if (new_size < MM_KHEAP_MIN) new_size = MM_KHEAP_MIN;
-	for (i = aheap->end - aheap->start - FRAME_SIZE; new_size < i; i -= FRAME_SIZE)
-		free_page(aheap->start + i, kernel_directory);
-	aheap->end = aheap->start + new_size;
-	return new_size;
+//Short of frames every free page goes back, otherwise some stay for the next malloc
+static UINT heap_keep(void)
+{
+	return (nr_free_frames < nr_frames / 16) ? 0 : MM_TRIM_KEEP;
 }
 
-static void heap_add_entry(mm_header *entry, heap *aheap)
+/*
+ * A hole just became the last block. Giving back its pages right away made
+ * the heap map and unmap the same pages under a steady alloc/free load, so
+ * only a big tail goes at once, the rest waits for heap_trim.
+ */
+static void heap_tail_freed(mm_hole *hole, heap *aheap)
 {
-	UINT i;
-	mm_header *tmp, *tmp2;
+	UINT keep = heap_keep();
 
-	for (i = 0; (i < aheap->entrycount) && (aheap->entries[i]->size < entry->size); i++);
-	if (i == aheap->entrycount)
-		aheap->entries[aheap->entrycount++] = entry;
-	else {
-		tmp = aheap->entries[i];
-		aheap->entries[i] = entry;
-		while (i++ < aheap->entrycount) {
-			tmp2 = aheap->entries[i];
-			aheap->entries[i] = tmp;
-			tmp = tmp2;
-		}
-		aheap->entrycount++;
-	}
+	if ((hole->header.size >= MM_TRIM_HIGH) || !keep) contract_heap(hole, keep, aheap);
 }
 
-static void heap_del_entry(UINT i, heap *aheap)
+//Called by the idle task
+void heap_trim(heap *aheap)
 {
-	if (i == MM_NO_HOLE) return;
-	for (; i < aheap->entrycount; i++)
-		aheap->entries[i] = aheap->entries[i+1];
-	aheap->entrycount--;
+	mm_footer *footer;
+	UINT flags;
+
+	if (!aheap) return;
+	irq_save(flags);
+	footer = (mm_footer *)(aheap->end - sizeof(mm_footer));
+	if ((aheap->end > aheap->start) && (footer->header->flag == MM_FLAG_HOLE)
+	    && contract_heap((mm_hole *)footer->header, heap_keep(), aheap))
+		aheap->trims++;
+	irq_restore(flags);
 }
 
-static UINT heap_find_entry(mm_header *entry, heap *aheap)
+//Where the block has to start inside the hole, MM_NO_HOLE if it doesn't fit
+static UINT heap_hole_offset(mm_hole *hole, UINT size, UCHAR page_align)
 {
-	UINT i;
-	for (i = 0; i < aheap->entrycount; i++)
-		if (aheap->entries[i] == entry) return i;
-	return MM_NO_HOLE;
-}
-
-static UINT find_smallest_hole(UINT size, UCHAR page_align, heap *aheap)  //Binary search?
-{
-	UINT i, location;
-	mm_header *entry;
-	int offset;
-
-	for (i = 0; i < aheap->entrycount; i++) {
-		entry = aheap->entries[i];
-		if (page_align) {
-			location = (UINT)entry;
-			offset = 0;
-			if (CHECK_ALIGN(location + sizeof(mm_header)))
-				offset = FRAME_SIZE - (location + sizeof(mm_header)) % FRAME_SIZE;
-			if ((int)entry->size - offset >= (int)size) return i;
-		} else if (entry->size >= size) return i;
+	UINT offset = 0;
+
+	if (page_align) {
+		offset = (FRAME_SIZE - (((UINT)hole + sizeof(mm_header)) & 0xFFF)) & 0xFFF;
+		if ((offset) && (offset < MM_MIN_BLOCK)) offset += FRAME_SIZE;
 	}
-	return MM_NO_HOLE;
+	if (hole->header.size < offset + size) return MM_NO_HOLE;
+	return offset;
+}
+
+static mm_hole *heap_find_hole(UINT size, UCHAR page_align, heap *aheap)
+{
+	UINT i, first, map;
+	mm_hole *hole;
+
+	//Every hole in bucket first and above fits, so the lowest nonempty one is taken
+	first = mm_log2(((page_align) ? size + FRAME_SIZE + MM_MIN_BLOCK : size) - 1) + 1;
+	if ((first < MM_NR_BUCKETS) && (map = aheap->bucketmap & (~0U << first)))
+		return aheap->buckets[mm_lowest_bit(map)];
+	//Otherwise only the buckets below can have a fitting hole
+	for (i = mm_log2(size); (i < first) && (i < MM_NR_BUCKETS); i++)
+		for (hole = aheap->buckets[i]; hole; hole = hole->next)
+			if (heap_hole_offset(hole, size, page_align) != MM_NO_HOLE) return hole;
+	return 0;
 }
 
 static void *heap_malloc(UINT size, UCHAR page_align, heap *aheap)
 {
-	UINT newsize = size + sizeof(mm_header) + sizeof(mm_footer);
-	UINT hole_pos = find_smallest_hole(newsize, page_align, aheap), oldsize, oldpos, newpos, oldend;
-	mm_header *header, *newheader;
-	mm_footer *newfooter;
-
-	if ((!size) || (!aheap)) return 0;
-	if (hole_pos == MM_NO_HOLE) {
-		oldsize = aheap->end - aheap->start;
-		oldend = aheap->end;
-		expand_heap(oldsize + newsize, aheap);
-		newsize = aheap->end - aheap->start;
-		UINT idx = MM_NO_HOLE;
-		UINT value = 0;
-		for (hole_pos = 0; hole_pos < aheap->entrycount; hole_pos++) {
-			UINT tmp = (UINT) aheap->entries[hole_pos];
-			if (tmp > value) {
-				value = tmp;
-				idx = hole_pos;
-			}
-		}
-		if (idx == MM_NO_HOLE) {
-			header = (mm_header *)oldend;
-			header->size = newsize - oldsize;
-			header->flag = MM_FLAG_HOLE;
-			newfooter = (mm_footer *) (oldend + header->size - sizeof(mm_footer));
-			header->magic = newfooter->magic = MM_MAGIC;
-			newfooter->header = header;
-			heap_add_entry(header, aheap);
-		} else  {
-			header = aheap->entries[idx];
-			header->size += newsize - oldsize;
-			newfooter = (mm_footer *) ((UINT)header + header->size - sizeof(mm_footer));
-			newfooter->header = header;
-			newfooter->magic = MM_MAGIC;
-		}
+	UINT newsize, offset, pos, rest;
+	mm_hole *hole;
+
+	if ((!size) || (!aheap) || (size > aheap->memend - aheap->start)) return 0;
+	newsize = heap_block_size(size);
+	if (!(hole = heap_find_hole(newsize, page_align, aheap))) {
+		if (!expand_heap(newsize + ((page_align) ? FRAME_SIZE + MM_MIN_BLOCK : 0), aheap)) return 0;
 		return heap_malloc(size, page_align, aheap);
 	}
-	header = aheap->entries[hole_pos];
-	if (header->size - sizeof(mm_header) - sizeof(mm_footer) < newsize) {
-		size += header->size - newsize;
-		newsize = header->size;
+	offset = heap_hole_offset(hole, newsize, page_align);
+	pos = (UINT)hole;
+	rest = hole->header.size;
+	heap_del_hole(hole, aheap);
+	if (offset) {
+		mm_set_block(pos, offset, MM_FLAG_HOLE);
+		heap_add_hole((mm_hole *)pos, aheap);
+		pos += offset;
+		rest -= offset;
 	}
-	oldpos = (UINT)header;
-	oldsize = header->size;
-	if (page_align && (oldpos & 0xFFFFF000)) {
-		newpos = oldpos + FRAME_SIZE - (oldpos & 0xFFF) - sizeof(mm_header);
-		newheader = (mm_header *) oldpos;
-		newfooter = (mm_footer *) ((UINT)newpos - sizeof(mm_footer));
-		newheader->size = newpos - oldpos;
-		newheader->flag = MM_FLAG_HOLE;
-		newheader->magic = newfooter->magic = MM_MAGIC;
-		newfooter->header = newheader;
-		oldpos = newpos;
-		oldsize = oldsize - newheader->size;
-	} else  {
-		heap_del_entry(hole_pos, aheap);
+	if (rest - newsize < MM_MIN_BLOCK) newsize = rest;
+	else {
+		mm_set_block(pos + newsize, rest - newsize, MM_FLAG_HOLE);
+		heap_add_hole((mm_hole *)(pos + newsize), aheap);
 	}
-	header = (mm_header *) oldpos;
-	newfooter = (mm_footer *) (oldpos + sizeof(mm_header) + size);
-	header->flag = MM_FLAG_BLOCK;
-	header->size = newsize;
-	header->magic = newfooter->magic = MM_MAGIC;
-	newfooter->header = header;
-	if (oldsize - newsize > 0) {
-		newheader = (mm_header *) (oldpos + newsize);
-		newheader->magic = MM_MAGIC;
-		newheader->flag = MM_FLAG_HOLE;
-		newheader->size = oldsize - newsize;
-		newfooter = (mm_footer *) ((UINT)newheader + newheader->size - sizeof(mm_footer));
-		if ((UINT)newfooter < aheap->end)  {
-			newfooter->magic = MM_MAGIC;
-			newfooter->header = newheader;
+	mm_set_block(pos, newsize, MM_FLAG_BLOCK);
+	aheap->allocs++;
+	aheap->blocks++;
+	aheap->used += newsize;
+	if (aheap->used > aheap->peak) aheap->peak = aheap->used;
+	return (void *)(pos + sizeof(mm_header));
+}
+
+static mm_header *heap_block(void *ptr, heap *aheap)
+{
+	mm_header *header = (mm_header *)((UINT)ptr - sizeof(mm_header));
+	mm_footer *footer;
+
+	if ((!ptr) || (!aheap) || ((UINT)header < aheap->start) || ((UINT)ptr >= aheap->end)) return 0;
+	if ((header->magic != MM_MAGIC) || (header->flag != MM_FLAG_BLOCK)) return 0;
+	footer = (mm_footer *)((UINT)header + header->size - sizeof(mm_footer));
+	if ((footer->magic != MM_MAGIC) || (footer->header != header)) return 0;
+	return header;
+}
+
+static void heap_free(void *ptr, heap *aheap)
+{
+	mm_header *header = heap_block(ptr, aheap), *next;
+	mm_footer *footer;
+	UINT pos, size;
+
+	if (!header) return;
+	pos = (UINT)header;
+	size = header->size;
+	aheap->frees++;
+	aheap->blocks--;
+	aheap->used -= size;
+	if (pos > aheap->start) {
+		footer = (mm_footer *)(pos - sizeof(mm_footer));
+		if (footer->header->flag == MM_FLAG_HOLE) {
+			pos = (UINT)footer->header;
+			size += footer->header->size;
+			heap_del_hole((mm_hole *)pos, aheap);
 		}
-		heap_add_entry(newheader, aheap);
 	}
-	return (void *) ((UINT)header + sizeof(mm_header));
+	next = (mm_header *)((UINT)header + header->size);
+	if (((UINT)next < aheap->end) && (next->flag == MM_FLAG_HOLE)) {
+		size += next->size;
+		heap_del_hole((mm_hole *)next, aheap);
+	}
+	mm_set_block(pos, size, MM_FLAG_HOLE);
+	heap_add_hole((mm_hole *)pos, aheap);
+	if (pos + size == aheap->end) heap_tail_freed((mm_hole *)pos, aheap);
 }
 
-static void heap_free(void *ptr, heap *aheap)
+//Gives the tail behind newsize back, merged with a hole behind the block
+static void heap_shrink_block(mm_header *header, UINT newsize, heap *aheap)
 {
-	mm_header *header, *tmpheader;
-	mm_footer *footer, *tmpfooter;
-	UINT oldsize, newsize;
-	UCHAR opt = 1;
+	mm_header *next = (mm_header *)((UINT)header + header->size);
+	UINT pos = (UINT)header + newsize, size = header->size - newsize;
+
+	if (!size) return;
+	if (((UINT)next < aheap->end) && (next->flag == MM_FLAG_HOLE)) {
+		size += next->size;
+		heap_del_hole((mm_hole *)next, aheap);
+	} else if (size < MM_MIN_BLOCK) return;
+	aheap->used -= header->size - newsize;
+	mm_set_block((UINT)header, newsize, MM_FLAG_BLOCK);
+	mm_set_block(pos, size, MM_FLAG_HOLE);
+	heap_add_hole((mm_hole *)pos, aheap);
+	if (pos + size == aheap->end) heap_tail_freed((mm_hole *)pos, aheap);
+}
 
-	if ((!ptr) || (!aheap)) return;
-	header = (mm_header*) ((UINT)ptr - sizeof(mm_header));
-	footer = (mm_footer*) ((UINT)header + header->size - sizeof(mm_footer));
-	if ((header->magic != MM_MAGIC) || (footer->magic != MM_MAGIC)) return;
-	oldsize = header->size;
-	header->flag = MM_FLAG_HOLE;
-	tmpfooter = (mm_footer*) ((UINT)header - sizeof(mm_footer));
-	if ((tmpfooter->magic == MM_MAGIC) && (tmpfooter->header->magic == MM_MAGIC) && (tmpfooter->header->flag == MM_FLAG_HOLE)) {
-		opt = 0;
-		header = tmpfooter->header;
-		footer->header = header;
-		header->size += oldsize;
-	}
+//Grows a block over the hole behind it, expands the heap if the block is the last one
+static int heap_grow_block(mm_header *header, UINT newsize, heap *aheap)
+{
+	mm_header *next = (mm_header *)((UINT)header + header->size);
+	UINT need = newsize - header->size;
 
-	tmpheader = (mm_header*) ((UINT)footer + sizeof(mm_footer));
-	if ((tmpheader->magic == MM_MAGIC) && (tmpheader->flag == MM_FLAG_HOLE)) {
-		header->size += tmpheader->size;
-		footer = (mm_footer*) ((UINT)tmpheader + tmpheader->size - sizeof(mm_footer));
-		heap_del_entry(heap_find_entry(tmpheader, aheap), aheap);
+	if ((UINT)next < aheap->end) {
+		if (next->flag != MM_FLAG_HOLE) return 0;
+		if ((next->size < need) && ((UINT)next + next->size != aheap->end)) return 0;
 	}
-	if ((UINT)footer + sizeof(mm_footer) == aheap->end) {
-		oldsize = aheap->end - aheap->start;
-		newsize = contract_heap((UINT)header - aheap->start, aheap);
-		if (newsize + header->size > oldsize) {
-			header->size -= oldsize - newsize;
-			footer = (mm_footer*) ((UINT)header + header->size - sizeof(mm_footer));
-			footer->magic = MM_MAGIC;
-			footer->header = header;
-		} else heap_del_entry(heap_find_entry(header, aheap), aheap);
-	}
-	if (opt) heap_add_entry(header, aheap);
+	if (((UINT)next == aheap->end) || (next->size < need))
+		if (!expand_heap((need < MM_MIN_BLOCK) ? MM_MIN_BLOCK : need, aheap)) return 0;
+	aheap->used += next->size;
+	heap_del_hole((mm_hole *)next, aheap);
+	mm_set_block((UINT)header, header->size + next->size, MM_FLAG_BLOCK);
+	if (aheap->used > aheap->peak) aheap->peak = aheap->used;
+	heap_shrink_block(header, newsize, aheap);
+	return 1;
 }
 
 static void *heap_realloc(void *ptr, UINT size, heap *aheap)
 {
-	mm_header *header, *tmpheader;
-	mm_footer *footer, *tmpfooter;
+	mm_header *header = heap_block(ptr, aheap);
+	UINT newsize, oldsize;
+	void *res;
 
-	if ((!ptr) || (!aheap)) return 0;
+	if (!ptr) return heap_malloc(size, 0, aheap);
+	if (!header) return 0;
 	if (!size) {
 		heap_free(ptr, aheap);
 		return 0;
 	}
-	header = (mm_header*) ((UINT)ptr - sizeof(mm_header));
-	footer = (mm_footer*) ((UINT)header + header->size - sizeof(mm_footer));
-	if ((header->magic != MM_MAGIC) || (footer->magic != MM_MAGIC)) return 0;
-	if (size == header->size - sizeof(mm_header) - sizeof(mm_footer)) return ptr;
-	else if (size < header->size - sizeof(mm_header) - sizeof(mm_footer)) {
-		if (header->size - size - 2 * (sizeof(mm_header) - sizeof(mm_footer)) < 0) return ptr;
-		tmpheader = (mm_header*) ((UINT)ptr + size + sizeof(mm_footer));
-		tmpfooter = (mm_footer*) ((UINT)ptr + size);
-		footer->header = tmpheader;
-		tmpfooter->header = header;
-		tmpheader->magic = tmpfooter->magic = MM_MAGIC;
-		tmpheader->flag = MM_FLAG_BLOCK;
-		tmpheader->size = (UINT)footer - (UINT)tmpheader + sizeof(mm_footer);
-		header->size = sizeof(mm_header) + size + sizeof(mm_footer);
-		heap_free((void *)((UINT)tmpheader + sizeof(mm_header)), aheap);
+	newsize = heap_block_size(size);
+	oldsize = header->size;
+	if ((newsize <= oldsize) || (heap_grow_block(header, newsize, aheap))) {
+		if (newsize < oldsize) heap_shrink_block(header, newsize, aheap);
+		aheap->reallocs_inplace++;
 		return ptr;
-	} else {
-		void *res = heap_malloc(size, 0, aheap);
+	}
+	if (!(res = heap_malloc(size, 0, aheap))) return 0;
+	memcpy(res, ptr, oldsize - sizeof(mm_header) - sizeof(mm_footer));
+	heap_free(ptr, aheap);
+	aheap->reallocs_moved++;
+	return res;
+}
 
-		if (!res) return 0;
-		memcpy(res, ptr, size);
-		heap_free(ptr, aheap);
-		return res;
+void heap_get_info(heap *aheap, heap_info *info)
+{
+	UINT i;
+	mm_hole *hole;
+
+	memset(info, 0, sizeof(heap_info));
+	info->size = aheap->end - aheap->start;
+	for (i = 0; i < MM_NR_BUCKETS; i++)
+		for (hole = aheap->buckets[i]; hole; hole = hole->next) {
+			info->histogram[i]++;
+			info->holes++;
+			info->free += hole->header.size;
+			if (hole->header.size > info->largest) info->largest = hole->header.size;
+		}
+}
+
+#ifdef MM_TRACE_CALLERS
+static mm_caller *mm_trace_slot(UINT caller)
+{
+	UINT i;
+
+	if (!caller) return mm_callers;
+	for (i = 1; i < MM_NR_CALLERS; i++) {
+		if (!mm_callers[i].caller) mm_callers[i].caller = caller;
+		if (mm_callers[i].caller == caller) return &mm_callers[i];
 	}
+	return mm_callers; //Table full, counted as unknown
 }
 
+static void mm_trace_alloc(void *ptr, UINT caller)
+{
+	mm_header *header = heap_block(ptr, kheap);
+	mm_caller *slot;
+
+	if (!header) return;
+	header->caller = caller;
+	slot = mm_trace_slot(caller);
+	slot->allocs++;
+	slot->blocks++;
+	slot->live += header->size;
+}
+
+static void mm_trace_free(void *ptr)
+{
+	mm_header *header = heap_block(ptr, kheap);
+	mm_caller *slot;
+
+	if (!header) return;
+	slot = mm_trace_slot(header->caller);
+	slot->blocks--;
+	slot->live -= header->size;
+}
+#endif
 
 void *malloc(UINT size)
 {
+	void *res;
+
 	if (!kheap) return (void *)_kmalloc(size);
-	else return heap_malloc(size, 0, kheap);
+#ifndef MM_TRACE_CALLERS //Everything goes through the heap to see the callers
+	if ((res = kmalloc_small(size))) return res;
+#endif
+	res = heap_malloc(size, 0, kheap);
+	TRACE_ALLOC(res, CALLER());
+	return res;
 }
 
 void *calloc(UINT num, UINT size)
 {
-	void *res = malloc(num * size);
+	void *res;
 
+	if (!kheap) res = (void *)_kmalloc(num * size);
+	else {
+		res = 0;
+#ifndef MM_TRACE_CALLERS
+		res = kmalloc_small(num * size);
+#endif
+		if (!res) {
+			res = heap_malloc(num * size, 0, kheap);
+			TRACE_ALLOC(res, CALLER());
+		}
+	}
 	if (!res) return 0;
 	memset(res, 0, num * size);
 	return res;
@@ -347,10 +482,29 @@ void *calloc(UINT num, UINT size)
 
 void free(void *ptr)
 {
+	if (kmalloc_free_obj(ptr)) return;
+	TRACE_FREE(ptr);
 	heap_free(ptr, kheap);
 }
 
 void *realloc(void *ptr, UINT size)
 {
-	return heap_realloc(ptr, size, kheap);
+	UINT objsize = kmalloc_obj_size(ptr);
+	void *res;
+
+	if (!objsize) {
+		TRACE_FREE(ptr);
+		res = heap_realloc(ptr, size, kheap);
+		TRACE_ALLOC((res || !size) ? res : ptr, CALLER());
+		return res;
+	}
+	if (!size) {
+		kmalloc_free_obj(ptr);
+		return 0;
+	}
+	if (size <= objsize) return ptr;
+	if (!(res = malloc(size))) return 0;
+	memcpy(res, ptr, objsize);
+	kmalloc_free_obj(ptr);
+	return res;
 }
@@ -0,0 +1,91 @@
+/*
+ *  Copyright (C) 2008 Sven Köhler
+ *
+ *  This file is part of Nupkux.
+ *
+ *  Nupkux is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nupkux is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Nupkux.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <task.h>
+#include <vma.h>
+#include <sys/mman.h>
+#include <kernel/syscall.h>
+#include <errno.h>
+
+#define USER_PAGE_FLAGS	(PAGE_FLAG_PRESENT | PAGE_FLAG_WRITE | PAGE_FLAG_USERMODE)
+
+static UINT page_round(UINT value)
+{
+	return (CHECK_ALIGN(value)) ? ALIGN_UP(value) : value;
+}
+
+//The heap lies behind the image, its pages come on the first access like all others
+UINT sys_brk(UINT addr)
+{
+	vm_area **list = (vm_area **)&current_task->vmas, *area;
+	UINT old = page_round(current_task->brk), new;
+
+	if (!current_task->brk_start) return 0; //No image, no heap
+	if ((addr < current_task->brk_start) || (addr > USER_MMAP_BASE)) return current_task->brk;
+	new = page_round(addr);
+	if (new > old) {
+		if (vma_overlap(*list, old, new)) return current_task->brk;
+		area = (old > current_task->brk_start) ? vma_find(*list, old - 1) : 0;
+		if (area && !area->node && (area->end == old)) area->end = new;
+		else if (vma_map(list, old, new - old, USER_PAGE_FLAGS, 0, 0, 0)) return current_task->brk;
+	} else if (new < old) vma_unmap(list, new, old, current_directory);
+	current_task->brk = addr;
+	return addr;
+}
+
+static UINT mmap_find_gap(vm_area *list, UINT len)
+{
+	UINT addr = USER_MMAP_BASE;
+	vm_area *area;
+
+	while (addr + len <= USER_MMAP_END) {
+		if (!(area = vma_overlap(list, addr, addr + len))) return addr;
+		addr = area->end;
+	}
+	return 0;
+}
+
+int sys_mmap(struct mmap_args *args)
+{
+	vm_area **list = (vm_area **)&current_task->vmas;
+	struct mmap_args a;
+	UINT addr, len, flags = PAGE_FLAG_PRESENT | PAGE_FLAG_USERMODE;
+	int res;
+
+	if (copy_from_user(&a, args, sizeof(struct mmap_args))) return -EFAULT;
+	if (!(a.flags & MAP_ANONYMOUS)) return -ENODEV; //No file mappings yet
+	if (!(a.flags & MAP_PRIVATE) || (a.flags & MAP_SHARED)) return -EINVAL;
+	if (!(a.prot & (PROT_READ | PROT_WRITE | PROT_EXEC))) return -EINVAL; //A page without access would fault forever
+	if (!a.len || (a.len > USER_MMAP_END - USER_MMAP_BASE)) return -EINVAL;
+	len = page_round(a.len);
+	if (a.prot & PROT_WRITE) flags |= PAGE_FLAG_WRITE;
+	if (a.flags & MAP_FIXED) {
+		addr = a.addr;
+		if (CHECK_ALIGN(addr) || (addr < USER_MMAP_BASE) || (addr > USER_MMAP_END - len)) return -EINVAL;
+		if ((res = vma_unmap(list, addr, addr + len, current_directory))) return res;
+	} else if (!(addr = mmap_find_gap(*list, len))) return -ENOMEM;
+	if ((res = vma_map(list, addr, len, flags, 0, 0, 0))) return res;
+	return addr; //Below 2GB, so it can't be taken for an error
+}
+
+int sys_munmap(UINT addr, size_t len)
+{
+	if (CHECK_ALIGN(addr) || !len || (addr + len < addr)) return -EINVAL;
+	return vma_unmap((vm_area **)&current_task->vmas, addr, page_round(addr + len), current_directory);
+}
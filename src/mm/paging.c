@@ -22,21 +22,33 @@
 #include <kernel/ktextio.h>
 #include <kernel/dts.h>
 #include <task.h>
+#include <vma.h>
 
 page_directory *current_directory, *kernel_directory;
 
-static UINT framecount = 0;
-static UINT *framemap;
+UINT nr_frames = 0, nr_free_frames = 0;
+static frame *frames;
+static UINT free_area[NR_ZONES][MAX_ORDER + 1];	//Freed frames are reused first, they're still cache-hot
+static kmem_pool directory_pool, table_pool;
+static UINT zero_frame = 0;	//Shared read-only by all untouched anonymous pages, pinned, never counted
+static UINT zero_pool[ZERO_POOL_SIZE], zero_pool_count = 0;	//Frames cleared while idle
+static page_table *kmap_table = 0;	//Shared by every directory
+static int kernel_pdes_shared = 0;	//Directories copy the kernel half, its PDEs are fixed from then on
 
 extern UINT kmalloc_pos;
+extern UINT _kmalloc_a(UINT sz);
 extern UINT _kmalloc_pa(UINT sz, UINT *phys);
 extern heap *kheap;
-extern void clone_page(UINT src, UINT dest);
+extern int fixup_exception(registers *regs); //uaccess.c
 
+//Physical memory, the kernel finds it at P2V
 #define MAP_MEMORY(start,end,flags) for (i=start;i<=end;i+=FRAME_SIZE) \
-		make_page(i,flags,kernel_directory,1)
+		claim_frame(make_page(P2V(i),flags,kernel_directory,0),i/FRAME_SIZE,flags)
 
-#define KERNEL_FLAGS	(PAGE_FLAG_READONLY | PAGE_FLAG_PRESENT)
+static UINT page_global = 0;	//PAGE_FLAG_GLOBAL if the CPU has PGE
+
+#define KERNEL_FLAGS	(PAGE_FLAG_WRITE | PAGE_FLAG_PRESENT | page_global)	//CR0.WP is set, so the kernel needs write access
+#define IPC_FLAGS	(PAGE_FLAG_WRITE | PAGE_FLAG_USERMODE | PAGE_FLAG_PRESENT | page_global)
 
 static void set_page_directory(page_directory *dir)
 {
@@ -44,31 +56,278 @@ static void set_page_directory(page_directory *dir)
 	asm volatile (	"cli\n\t"
 	                "movl %%eax,%%cr3\n\t"
 	                "movl %%cr0,%%eax\n\t"
-	                "orl  $0x80000000,%%eax\n\t"
+	                "orl  $0x80010000,%%eax\n\t"
 	                "movl %%eax,%%cr0\n\t"
 	                "sti"::"a"(dir->physPos));
 }
 
-static UINT first_frame(void)
+#define ZONE_OF(NUMBER)	(((NUMBER) < DMA_ZONE_END / FRAME_SIZE) ? ZONE_DMA : ZONE_NORMAL)
+
+static void push_block(UINT number, UINT order)
+{
+	UINT *head = &free_area[ZONE_OF(number)][order];
+
+	frames[number].flags = FRAME_FLAG_FREE;
+	frames[number].order = order;
+	frames[number].prev = NO_FRAME;
+	frames[number].next = *head;
+	if (*head != NO_FRAME) frames[*head].prev = number;
+	*head = number;
+	nr_free_frames += 1 << order;
+}
+
+static void unlink_block(UINT number, UINT order)
 {
-	UINT i, j;
+	frame *aframe = &frames[number];
 
-	for (i = 0; i < framecount / 32; i++)
-		if (framemap[i] != 0xFFFFFFFF)
-			for (j = 0; j < 32; j++)
-				if (!(framemap[i]&(1 << j)))
-					return i * 32 + j;
-	return 0xFFFFFFFF;
+	if (aframe->prev != NO_FRAME) frames[aframe->prev].next = aframe->next;
+	else free_area[ZONE_OF(number)][order] = aframe->next;
+	if (aframe->next != NO_FRAME) frames[aframe->next].prev = aframe->prev;
+	aframe->flags = 0;
+	nr_free_frames -= 1 << order;
+}
+
+static void mark_block(UINT number, UINT order)
+{
+	UINT i;
+
+	for (i = 0; i < (1 << order); i++) {
+		frames[number + i].flags = FRAME_FLAG_USED;
+		frames[number + i].count = 1;
+	}
+}
+
+static UINT alloc_block(UINT order, UINT zone)
+{
+	UINT i, number;
+
+	for (i = order; i <= MAX_ORDER; i++)
+		if (free_area[zone][i] != NO_FRAME) break;
+	if (i > MAX_ORDER) return NO_FRAME;
+	number = free_area[zone][i];
+	unlink_block(number, i);
+	while (i-- > order)
+		push_block(number + (1 << i), i);
+	mark_block(number, order);
+	return number;
+}
+
+static void free_block(UINT number, UINT order)
+{
+	UINT buddy;
+
+	while (order < MAX_ORDER) {
+		buddy = number ^ (1 << order);
+		if ((buddy >= nr_frames) || !(frames[buddy].flags & FRAME_FLAG_FREE) || (frames[buddy].order != order)) break;
+		unlink_block(buddy, order);
+		number &= buddy;
+		order++;
+	}
+	push_block(number, order);
+}
+
+//Every frame in [from, to) is free, gives them to the buddy allocator in blocks as big as possible
+static void free_range(UINT from, UINT to)
+{
+	UINT i, order;
+
+	for (i = from; i < to; i += 1 << order) {
+		for (order = MAX_ORDER; order && ((i & ((1 << order) - 1)) || (i + (1 << order) > to)); order--);
+		push_block(i, order);
+	}
+}
+
+//Frames outside the RAM of the memory map stay used forever
+static void setup_frames(void)
+{
+	UINT i, end;
+
+	for (i = 0; i < nr_frames; i++) {
+		frames[i].flags = FRAME_FLAG_USED;
+		frames[i].count = 1;
+	}
+	for (i = 0; i < mem_regions_count; i++)
+		for (end = mem_regions[i].start / FRAME_SIZE; (end < mem_regions[i].end / FRAME_SIZE) && (end < nr_frames); end++)
+			frames[end].flags = frames[end].count = 0;
+	frames[0].flags = FRAME_FLAG_USED; //Frame 0 means "no frame" in a page
+	for (i = 1; i < nr_frames; i = end) { //The map may be unsorted or overlapping
+		for (end = i; (end < nr_frames) && !frames[end].flags; end++);
+		if (end == i) end++;
+		else free_range(i, end);
+	}
+}
+
+//Cuts a single free frame out of whatever block holds it
+static void take_frame(UINT number)
+{
+	UINT order, head = number;
+
+	for (order = 0; order <= MAX_ORDER; order++) {
+		head = number & ~((1 << order) - 1);
+		if ((frames[head].flags & FRAME_FLAG_FREE) && (frames[head].order == order)) break;
+	}
+	if (order > MAX_ORDER) return;
+	unlink_block(head, order);
+	while (order--) {
+		if (number & (1 << order)) {
+			push_block(head, order);
+			head += 1 << order;
+		} else push_block(head + (1 << order), order);
+	}
+	mark_block(number, 0);
+}
+
+/*
+ * Maps any frame at a fixed slot, so it can be reached without turning off
+ * paging. There are no separate slots for interrupts and a task switch would
+ * reuse them, so callers keep interrupts off while they hold one.
+ */
+void *kmap(UINT slot, UINT phys)
+{
+	UINT address = KMAP_BASE + slot * FRAME_SIZE;
+
+	kmap_table->entries[slot].frame = phys / FRAME_SIZE;
+	kmap_table->entries[slot].flags = PAGE_FLAG_WRITE | PAGE_FLAG_PRESENT;
+	invlpg(address);
+	return (void *)address;
+}
+
+static UINT ioremap_pos = IOREMAP_BASE;
+
+//Firmware tables may lie anywhere, they stay mapped and their frames aren't counted
+void *ioremap(UINT phys, UINT size)
+{
+	UINT offset = CHECK_ALIGN(phys), pages, i, res = ioremap_pos;
+	page *apage;
+
+	if (!size || (phys + size < phys)) return 0;
+	pages = (offset + size + FRAME_SIZE - 1) / FRAME_SIZE;
+	if (pages > (IOREMAP_END - ioremap_pos) / FRAME_SIZE) return 0;
+	for (i = 0; i < pages; i++) {
+		apage = get_page(res + i * FRAME_SIZE, 0, kernel_directory);
+		apage->frame = ALIGN_DOWN(phys) / FRAME_SIZE + i;
+		apage->flags = KERNEL_FLAGS;
+	}
+	ioremap_pos += pages * FRAME_SIZE;
+	return (void *)(res + offset);
+}
+
+static void clone_page(UINT src, UINT dest)
+{
+	UINT eflags;
+
+	irq_save(eflags);
+	memcpy(kmap(KM_DST, dest), kmap(KM_SRC, src), FRAME_SIZE);
+	irq_restore(eflags);
+}
+
+static void clear_page(UINT phys)
+{
+	UINT eflags;
+
+	irq_save(eflags);
+	memset(kmap(KM_DST, phys), 0, FRAME_SIZE);
+	irq_restore(eflags);
 }
 
 static void alloc_frame(page *apage, UINT flags)
 {
-	UINT number = first_frame();
+	UINT number;
+
+	if (apage->frame) return;
+	//Keep the DMA zone for those who need it
+	if ((number = alloc_block(0, ZONE_NORMAL)) == NO_FRAME)
+		number = alloc_block(0, ZONE_DMA);
+	if ((number == NO_FRAME) && zero_pool_count) number = zero_pool[--zero_pool_count];
+	if (number == NO_FRAME) return; //Stays not present, the access will fault
+	apage->frame = number;
+	apage->flags = flags;
+}
 
+static void alloc_zeroed_frame(page *apage, UINT flags)
+{
 	if (apage->frame) return;
+	if (zero_pool_count) {
+		apage->frame = zero_pool[--zero_pool_count];
+		apage->flags = flags;
+		return;
+	}
+	alloc_frame(apage, flags);
+	if (apage->frame) clear_page(apage->frame * FRAME_SIZE);
+}
+
+//Maps exactly this frame, the kernel needs its low memory at P2V
+static void claim_frame(page *apage, UINT number, UINT flags)
+{
+	if (!apage || apage->frame || (number >= nr_frames)) return;
+	if (!(frames[number].flags & FRAME_FLAG_USED)) take_frame(number);
+	else frames[number].count++;
 	apage->frame = number;
 	apage->flags = flags;
-	framemap[number/32] |= (1 << (number % 32));
+}
+
+static void put_frame(UINT number)
+{
+	if (!number || number == zero_frame || !frames[number].count || --frames[number].count) return;
+	free_block(number, 0);
+}
+
+UINT alloc_pages(UINT order, UINT flags)
+{
+	UINT number = NO_FRAME;
+
+	if (order > MAX_ORDER) return 0;
+	if (!(flags & PAGE_ALLOC_DMA)) number = alloc_block(order, ZONE_NORMAL);
+	if (number == NO_FRAME) number = alloc_block(order, ZONE_DMA);
+	if (number == NO_FRAME) return 0;
+	return number * FRAME_SIZE;
+}
+
+void free_pages(UINT phys, UINT order)
+{
+	UINT number = phys / FRAME_SIZE, i;
+
+	if (!number || (order > MAX_ORDER) || (number + (1 << order) > nr_frames)) return;
+	for (i = 0; i < (1 << order); i++) {
+		frames[number + i].count = 0;
+		frames[number + i].flags = 0;
+	}
+	free_block(number, order);
+}
+
+//Physically contiguous and below 16MB, mapped at DMA_VIRT(phys) for the kernel
+void *dma_alloc(UINT order, UINT *phys)
+{
+	UINT addr = alloc_pages(order, PAGE_ALLOC_DMA), i;
+	page *apage;
+
+	if (!addr) return 0;
+	if (addr + (FRAME_SIZE << order) > DMA_ZONE_END) {
+		free_pages(addr, order);
+		return 0;
+	}
+	for (i = 0; i < (1 << order); i++) {
+		apage = get_page(DMA_VIRT(addr) + i * FRAME_SIZE, 0, kernel_directory);
+		apage->frame = addr / FRAME_SIZE + i;
+		apage->flags = KERNEL_FLAGS;
+	}
+	if (phys) *phys = addr;
+	return (void *)DMA_VIRT(addr);
+}
+
+void dma_free(void *addr, UINT order)
+{
+	UINT i;
+	page *apage;
+
+	if (!addr) return;
+	for (i = 0; i < (1 << order); i++) {
+		apage = get_page((UINT)addr + i * FRAME_SIZE, 0, kernel_directory);
+		apage->frame = 0;
+		apage->flags = 0;
+		invlpg((UINT)addr + i * FRAME_SIZE);
+	}
+	free_pages((UINT)addr - DMA_VIRT_BASE, order);
 }
 
 static void free_frame(page *apage)
@@ -76,94 +335,192 @@ static void free_frame(page *apage)
 	UINT number = apage->frame;
 
 	apage->frame = 0;
-	if (number) framemap[number/32] &= ~(1 << (number % 32));
+	put_frame(number);
+}
+
+//A new heap page gets a frame cleared while idle, else a recycled table is cleared now
+static page_table *alloc_table(UINT *phys)
+{
+	page_table *res;
+	page *apage;
+	UINT old;
+
+	if (!kheap || !zero_pool_count || !(res = (page_table *)_kmalloc_a(sizeof(page_table)))) {
+		if ((res = (page_table *)kmem_pool_alloc(&table_pool, phys))) memset(res, 0, sizeof(page_table));
+		return res;
+	}
+	apage = get_page((UINT)res, 0, kernel_directory);
+	old = apage->frame;
+	apage->frame = zero_pool[--zero_pool_count];
+	invlpg((UINT)res);
+	put_frame(old);
+	*phys = apage->frame * FRAME_SIZE;
+	return res;
 }
 
 static page_table *make_table(UINT index, UINT flags, page_directory *directory)
 {
-	page_table *res = (page_table *)_kmalloc_pa(sizeof(page_table), &(directory->physTabs[index]));
+	UINT phys = 0;
+	page_table *res = alloc_table(&phys);
 
-	directory->physTabs[index] |= flags;
-	memset(res, 0, sizeof(page_table));
+	if (!res) return 0;
+	directory->physTabs[index] = phys | flags;
 	directory->tables[index] = res;
 	return res;
 }
 
+static void map_large_page(UINT address, UINT flags, page_directory *directory)
+{
+	UINT i, number = address / FRAME_SIZE;
+
+	for (i = 0; i < 1024; i++, number++) {
+		if (number >= nr_frames) break;
+		if (!(frames[number].flags & FRAME_FLAG_USED)) take_frame(number);
+		else frames[number].count++;
+	}
+	directory->physTabs[P2V(address) / LARGE_PAGE_SIZE] = address | flags | PAGE_FLAG_LARGE;
+}
+
+//Somebody wants a single page out of a 4MB one, so it gets a table again
+static int split_large_page(UINT tab, page_directory *directory)
+{
+	UINT i, phys, entry = directory->physTabs[tab];
+	UINT flags = entry & 0xFFF & ~PAGE_FLAG_LARGE;
+	page_table *table;
+
+	if (kernel_pdes_shared && (tab >= KERNEL_PDE_FIRST)) {
+		printf("split_large_page: 0x%X is shared by every directory\n", tab * LARGE_PAGE_SIZE);
+		return 0;
+	}
+	if (!(table = (page_table *)kmem_pool_alloc(&table_pool, &phys))) return 0;
+	for (i = 0; i < 1024; i++) {
+		table->entries[i].frame = (entry & ~(LARGE_PAGE_SIZE - 1)) / FRAME_SIZE + i;
+		table->entries[i].flags = flags;
+	}
+	directory->tables[tab] = table;
+	directory->physTabs[tab] = phys | flags;
+	invlpg(tab * LARGE_PAGE_SIZE);
+	return 1;
+}
+
 page *make_page(UINT address, UINT flags, page_directory *directory, int alloc)
 {
 	UINT index = address / FRAME_SIZE;
 	UINT tab = index / 1024;
 
-	if (!directory->physTabs[tab]) make_table(tab, flags, directory);
+	if ((directory->physTabs[tab] & PAGE_FLAG_LARGE) && !split_large_page(tab, directory)) return 0;
+	if (!directory->physTabs[tab] && !make_table(tab, flags, directory)) return 0;
 	if (alloc) alloc_frame(&(directory->tables[tab]->entries[index%1024]), flags);
 	return &(directory->tables[tab]->entries[index%1024]);
 }
 
+page *make_zeroed_page(UINT address, UINT flags, page_directory *directory)
+{
+	page *apage = make_page(address, flags | PAGE_FLAG_WRITE, directory, 0); //The page decides, not the table
+
+	if (apage) alloc_zeroed_frame(apage, flags);
+	return apage;
+}
+
+//Reading an untouched page costs no frame, the first write copies it
+page *map_zero_page(UINT address, UINT flags, page_directory *directory)
+{
+	page *apage = make_page(address, flags | PAGE_FLAG_WRITE, directory, 0);
+
+	if (!apage || apage->frame) return apage;
+	if (flags & PAGE_FLAG_WRITE) flags = (flags & ~PAGE_FLAG_WRITE) | PAGE_FLAG_COW;
+	apage->frame = zero_frame;
+	apage->flags = flags;
+	return apage;
+}
+
+//Called by the idle task, clears frames ahead of time for make_zeroed_page
+void refill_zero_pool(UINT count)
+{
+	UINT number;
+
+	while (count-- && (zero_pool_count < ZERO_POOL_SIZE)) {
+		cli();
+		if ((number = alloc_block(0, ZONE_NORMAL)) == NO_FRAME)
+			number = alloc_block(0, ZONE_DMA); //Machines of 16MB have no other
+		if (number == NO_FRAME) {
+			sti();
+			return;
+		}
+		clear_page(number * FRAME_SIZE);
+		zero_pool[zero_pool_count++] = number;
+		sti();
+	}
+}
+
 page *free_page(UINT address, page_directory *directory)
 {
 	UINT index = address / FRAME_SIZE;
 	UINT tab = index / 1024;
 
 	if (!directory->physTabs[tab]) return 0;
+	if ((directory->physTabs[tab] & PAGE_FLAG_LARGE) && !split_large_page(tab, directory)) return 0;
 	free_frame(&(directory->tables[tab]->entries[index%1024]));
+	invlpg(address);
 	return &(directory->tables[tab]->entries[index%1024]);
 }
 
 static page_table* clone_table(page_table* src, UINT* physAddr)
 {
 	UINT i = 1024;
-	page_table *table = (page_table*)_kmalloc_pa(sizeof(page_table), physAddr);
+	page *apage;
+	page_table *table = alloc_table(physAddr);
 
-	memset(table, 0, sizeof(page_table));
 	while (i--) {
-		if (!src->entries[i].frame) continue;
-		alloc_frame(&table->entries[i], src->entries[i].flags);
-		clone_page(src->entries[i].frame * FRAME_SIZE, table->entries[i].frame * FRAME_SIZE);
+		apage = &src->entries[i];
+		if (!apage->frame) continue;
+		if (apage->flags & PAGE_FLAG_STACK) {
+			alloc_frame(&table->entries[i], apage->flags);
+			clone_page(apage->frame * FRAME_SIZE, table->entries[i].frame * FRAME_SIZE);
+			continue;
+		}
+		//Both share the frame read-only, the first write copies it
+		if (apage->flags & PAGE_FLAG_WRITE)
+			apage->flags = (apage->flags & ~PAGE_FLAG_WRITE) | PAGE_FLAG_COW;
+		table->entries[i] = *apage;
+		if (apage->frame != zero_frame) frames[apage->frame].count++;
 	}
 	return table;
 }
 
 page_directory* clone_directory(page_directory* src)
 {
-	UINT phys, i = 1024;
-	page_directory *dir = (page_directory *)_kmalloc_pa(sizeof(page_directory), &phys);
+	UINT phys, i = KERNEL_PDE_FIRST;
+	page_directory *dir = (page_directory *)kmem_pool_alloc(&directory_pool, &phys);
 
 	memset(dir, 0, sizeof(page_directory));
 	dir->physPos = phys; //+(UINT)dir->physTabs-(UINT)dir;
+	memcpy(&dir->physTabs[KERNEL_PDE_FIRST], &kernel_directory->physTabs[KERNEL_PDE_FIRST], (1024 - KERNEL_PDE_FIRST) * sizeof(UINT));
+	memcpy(&dir->tables[KERNEL_PDE_FIRST], &kernel_directory->tables[KERNEL_PDE_FIRST], (1024 - KERNEL_PDE_FIRST) * sizeof(page_table *));
 	while (i--) {
 		if (!src->tables[i]) continue;
-		if (kernel_directory->tables[i] == src->tables[i]) {
-			dir->tables[i] = src->tables[i];
-			dir->physTabs[i] = src->physTabs[i];
-		} else {
-			dir->tables[i] = clone_table(src->tables[i], &phys);
-			dir->physTabs[i] = phys | PAGE_FLAG_PRESENT | PAGE_FLAG_WRITE | PAGE_FLAG_USERMODE;
-		}
+		dir->tables[i] = clone_table(src->tables[i], &phys);
+		dir->physTabs[i] = phys | PAGE_FLAG_PRESENT | PAGE_FLAG_WRITE | PAGE_FLAG_USERMODE;
 	}
 	return dir;
 }
 
 static void free_table(page_table *table)
 {
-	UINT i = 1024, number;
-	while (i--) {
-		number = table->entries[i].frame;
+	UINT i = 1024;
+	while (i--)
 		//We cannot free page, because we are in this page_directory (Remind cli()!)
 		//So we will only "set free" the frame
-		if (number) framemap[number/32] &= ~(1 << (number % 32));
-	}
-	free(table);
+		put_frame(table->entries[i].frame);
+	kmem_pool_free(&table_pool, table);
 }
 
 void free_directory(page_directory *dir)
 {
-	UINT i = 1024;
-	while (i--) {
-		if (!dir->tables[i]) continue;
-		if (kernel_directory->tables[i] != dir->tables[i])
-			free_table(dir->tables[i]);
-	}
-	free(dir);
+	UINT i = KERNEL_PDE_FIRST;
+	while (i--)
+		if (dir->tables[i]) free_table(dir->tables[i]);
+	kmem_pool_free(&directory_pool, dir);
 }
 
 page *get_page(UINT address, int make, page_directory *directory)
@@ -171,6 +528,9 @@ page *get_page(UINT address, int make, page_directory *directory)
 	UINT index = address / FRAME_SIZE;
 	UINT tab = index / 1024;
 
+	if (directory->physTabs[tab] & PAGE_FLAG_LARGE) {
+		if (!make || !split_large_page(tab, directory)) return 0;
+	}
 	if (directory->physTabs[tab])
 		return &(directory->tables[tab]->entries[index%1024]);
 	else if (make)
@@ -178,40 +538,133 @@ page *get_page(UINT address, int make, page_directory *directory)
 	return 0;
 }
 
+static int break_cow(UINT address)
+{
+	page *apage = get_page(address, 0, current_directory);
+	UINT old;
+
+	if (!apage || !(apage->flags & PAGE_FLAG_COW)) return 0;
+	old = apage->frame;
+	if (old == zero_frame || frames[old].count > 1) {
+		apage->frame = 0;
+		if (old == zero_frame) alloc_zeroed_frame(apage, apage->flags);
+		else alloc_frame(apage, apage->flags);
+		if (!apage->frame) {
+			apage->frame = old;
+			return 0;
+		}
+		if (old != zero_frame) clone_page(old * FRAME_SIZE, apage->frame * FRAME_SIZE);
+		put_frame(old);
+	}
+	apage->flags = (apage->flags & ~PAGE_FLAG_COW) | PAGE_FLAG_WRITE;
+	invlpg(address);
+	return 1;
+}
+
 void page_fault_handler(registers *regs)
 {
 	UINT faultaddr;
 
 	asm volatile ("mov %%cr2,%%eax":"=a"(faultaddr));
+	if (((regs->err_code & 3) == 3) && break_cow(faultaddr)) return;
+	if (!(regs->err_code & 1) && current_task && vma_fault(faultaddr, regs->err_code & 2)) return;
+	if (fixup_exception(regs)) return; //Bad pointer in a syscall, it returns -EFAULT
 
 	printf("\nPagefault at 0x%X: %s%s%s%s\n", faultaddr, (!(regs->err_code & 1)) ? "present " : "", (regs->err_code & 2) ? "read-only " : "", (regs->err_code & 4) ? "user-mode " : "", (regs->err_code & 8) ? "reserved " : "");
 	abort_current_process();
 }
 
+//Mapped now or on the first access, either way it won't kill the process
+static int page_accessible(UINT address, int write)
+{
+	page *apage = get_page(address, 0, current_directory);
+	vm_area *area;
+
+	if (apage && apage->frame && (apage->flags & PAGE_FLAG_PRESENT)) {
+		if (!(apage->flags & PAGE_FLAG_USERMODE)) return 0;
+		return !write || (apage->flags & (PAGE_FLAG_WRITE | PAGE_FLAG_COW));
+	}
+	if (!current_task || !(area = vma_find(current_task->vmas, address))) return 0;
+	return !write || (area->flags & PAGE_FLAG_WRITE);
+}
+
 int access_ok(int type, const void* addr, UINT size)
-{	//TODO: Fill it!
+{
+	UINT address = (UINT)addr, pages;
+
+	if (!size) return 1;
+	if (!address || (address + size - 1 < address)) return 0;
+	if (address + size - 1 >= KERNEL_VIRT_BASE) return 0; //The kernel half is in every directory
+	pages = (ALIGN_DOWN(address + size - 1) - ALIGN_DOWN(address)) / FRAME_SIZE + 1;
+	for (address = ALIGN_DOWN(address); pages--; address += FRAME_SIZE)
+		if (!page_accessible(address, type == VERIFY_WRITE)) return 0;
 	return 1;
 }
 
-void setup_paging()
+static UINT cpu_features(void)
 {
-	UINT i = 0;
+	UINT eax = 1, ebx, ecx, edx;
+
+	asm volatile ("cpuid":"+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+	return edx;
+}
 
-	framecount = WORKING_MEMEND / FRAME_SIZE;
-	framemap = (UINT *)_kmalloc(framecount / 8); // sizeof(UINT)*fc/32
-	memset(framemap, 0, framecount / 8);
+void setup_paging()
+{
+	UINT i = 0, kernel_large = 0, ipc_large = WORKING_MEMSTART, ipc_large_end = WORKING_MEMSTART, heap_start, heap_end, features = cpu_features();
+
+	kmem_pool_init(&directory_pool, "page_directory", sizeof(page_directory), 4);
+	kmem_pool_init(&table_pool, "page_table", sizeof(page_table), KMEM_POOL_MAX);
+
+	nr_frames = WORKING_MEMEND / FRAME_SIZE;
+	frames = (frame *)_kmalloc(nr_frames * sizeof(frame));
+	memset(frames, 0, nr_frames * sizeof(frame));
+	memset(free_area, 0xFF, sizeof(free_area));
+	setup_frames();
+	if (features & CPUID_FEAT_PGE) {
+		asm volatile (	"movl %%cr4,%%eax\n\t"
+		                "orl  %0,%%eax\n\t"
+		                "movl %%eax,%%cr4"::"i"(CR4_PGE):"eax");
+		page_global = PAGE_FLAG_GLOBAL;
+	}
+	if (features & CPUID_FEAT_PSE) {
+		asm volatile (	"movl %%cr4,%%eax\n\t"
+		                "orl  %0,%%eax\n\t"
+		                "movl %%eax,%%cr4"::"i"(CR4_PSE):"eax");
+		//Only 4MB that are all kernel or all IPC, the one holding both gets a table
+		kernel_large = WORKING_MEMSTART & ~(LARGE_PAGE_SIZE - 1);
+		ipc_large = kernel_large + LARGE_PAGE_SIZE;
+		ipc_large_end = (WORKING_MEMSTART + IPC_MEMSIZE) & ~(LARGE_PAGE_SIZE - 1);
+		if (ipc_large_end < ipc_large) ipc_large_end = ipc_large;
+	}
 	kernel_directory = (page_directory *)_kmalloc_pa(sizeof(page_directory), &i);
 	memset(kernel_directory, 0, sizeof(page_directory));
-	kernel_directory->physPos = (UINT)kernel_directory->physTabs;
-	MAP_MEMORY(0, WORKING_MEMSTART, KERNEL_FLAGS); //Kernel & initrd
-	MAP_MEMORY(WORKING_MEMSTART, WORKING_MEMSTART + IPC_MEMSIZE, PAGE_FLAG_WRITE | PAGE_FLAG_USERMODE | PAGE_FLAG_PRESENT); //IPC
-	MAP_MEMORY(WORKING_MEMSTART + IPC_MEMSIZE, kmalloc_pos + FRAME_SIZE, KERNEL_FLAGS); //Pre-Heap
-	i = MM_KHEAP_START + kmalloc_pos;
-	ASSERT_ALIGN(i);
-	MAP_MEMORY(i, ALIGN_UP(kmalloc_pos) + MM_KHEAP_START + MM_KHEAP_SIZE, KERNEL_FLAGS); //Heap
+	kernel_directory->physPos = i;
+	for (i = 0; i < kernel_large; i += LARGE_PAGE_SIZE)
+		map_large_page(i, KERNEL_FLAGS, kernel_directory);
+	MAP_MEMORY(kernel_large, WORKING_MEMSTART, KERNEL_FLAGS); //Kernel & initrd
+	MAP_MEMORY(WORKING_MEMSTART, ipc_large - FRAME_SIZE, IPC_FLAGS); //IPC
+	for (i = ipc_large; i < ipc_large_end; i += LARGE_PAGE_SIZE)
+		map_large_page(i, IPC_FLAGS, kernel_directory);
+	MAP_MEMORY(ipc_large_end, WORKING_MEMSTART + IPC_MEMSIZE, IPC_FLAGS);
+	heap_start = MM_KHEAP_START + kmalloc_pos;
+	ASSERT_ALIGN(heap_start);
+	//The tables made on the way come from kmalloc_pos, which stays below heap_start
+	MAP_MEMORY(WORKING_MEMSTART + IPC_MEMSIZE, V2P(heap_start) + MM_KHEAP_SIZE, KERNEL_FLAGS); //Pre-Heap & Heap
 	register_interrupt_handler(14, page_fault_handler);
-	set_page_directory(kernel_directory);
-	kheap = create_heap(MM_KHEAP_START + kmalloc_pos, MM_KHEAP_START + MM_KHEAP_SIZE + kmalloc_pos, WORKING_MEMEND, KERNEL_FLAGS);
+	set_page_directory(kernel_directory); //The 1:1 mapping of the boot is gone
+	heap_end = (WORKING_MEMEND < V2P(MM_KHEAP_END)) ? P2V(WORKING_MEMEND) : MM_KHEAP_END;
+	kheap = create_heap(heap_start, heap_start + MM_KHEAP_SIZE, heap_end, KERNEL_FLAGS);
+	setup_kmalloc_caches();
+	//Every table of the kernel half exists from now on, so clone_directory just copies them
+	for (i = heap_start / LARGE_PAGE_SIZE; i <= (heap_end - 1) / LARGE_PAGE_SIZE; i++)
+		if (!kernel_directory->physTabs[i]) make_table(i, KERNEL_FLAGS, kernel_directory);
+	for (i = IOREMAP_BASE / LARGE_PAGE_SIZE; i < DMA_VIRT(DMA_ZONE_END) / LARGE_PAGE_SIZE; i++)
+		make_table(i, KERNEL_FLAGS, kernel_directory);
+	kmap_table = kernel_directory->tables[KMAP_BASE / LARGE_PAGE_SIZE];
+	zero_frame = alloc_pages(0, 0) / FRAME_SIZE;
+	clear_page(zero_frame * FRAME_SIZE);
+	kernel_pdes_shared = 1;
 	current_directory = clone_directory(kernel_directory);
 	set_page_directory(current_directory);
 }
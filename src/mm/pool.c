@@ -0,0 +1,68 @@
+/*
+ *  Copyright (C) 2008 Sven Köhler
+ *
+ *  This file is part of Nupkux.
+ *
+ *  Nupkux is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nupkux is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Nupkux.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Kernel stacks, page directories and page tables are page aligned, which is
+ * the expensive way through the heap. A pool keeps some of them when they are
+ * freed and hands them out again. Past its limit a freed object goes back to
+ * the heap, which writes into it, so nothing may still be in use when freed.
+ */
+
+#include <mm.h>
+
+extern UINT _kmalloc_a(UINT sz); //mm.c
+extern UINT _kmalloc_pa(UINT sz, UINT *phys);
+extern page_directory *kernel_directory;
+
+kmem_pool *kmem_pools = 0;
+
+void kmem_pool_init(kmem_pool *pool, const char *name, UINT objsize, UINT limit)
+{
+	memset(pool, 0, sizeof(kmem_pool));
+	pool->name = name;
+	pool->objsize = objsize;
+	pool->limit = (limit > KMEM_POOL_MAX) ? KMEM_POOL_MAX : limit;
+	pool->next = kmem_pools;
+	kmem_pools = pool;
+}
+
+void *kmem_pool_alloc(kmem_pool *pool, UINT *phys)
+{
+	UINT obj;
+	page *apage;
+
+	if (!pool->nr_free) {
+		pool->misses++;
+		return (void *)((phys) ? _kmalloc_pa(pool->objsize, phys) : _kmalloc_a(pool->objsize));
+	}
+	pool->hits++;
+	obj = pool->objs[--pool->nr_free];
+	if (phys) {
+		apage = get_page(obj, 0, kernel_directory);
+		*phys = (apage->frame * FRAME_SIZE) + (obj & 0xFFF);
+	}
+	return (void *)obj;
+}
+
+void kmem_pool_free(kmem_pool *pool, void *obj)
+{
+	if (!obj) return;
+	if (pool->nr_free < pool->limit) pool->objs[pool->nr_free++] = (UINT)obj;
+	else free(obj);
+}
@@ -0,0 +1,230 @@
+/*
+ *  Copyright (C) 2008 Sven Köhler
+ *
+ *  This file is part of Nupkux.
+ *
+ *  Nupkux is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nupkux is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Nupkux.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Small objects don't go through the hole index of the heap. They are cut out
+ * of whole pages (slabs), one cache per object size. Every slab keeps its free
+ * objects in a list, so allocating and freeing is just a pointer swap.
+ */
+
+#include <mm.h>
+#include <kernel/ktextio.h>
+
+#define KMEM_FIRST_OBJ(SLAB)	((UINT)(SLAB) + ((sizeof(kmem_slab) + KMEM_ALIGN - 1) & ~(KMEM_ALIGN - 1)))
+
+extern UINT _kmalloc_a(UINT sz); //mm.c
+
+kmem_cache *kmem_caches = 0;
+
+static kmem_cache kmalloc_caches[NR_KMALLOC_CACHES];
+static const char *kmalloc_names[NR_KMALLOC_CACHES] = {"kmalloc-16", "kmalloc-32", "kmalloc-64", "kmalloc-128", "kmalloc-256", "kmalloc-512", "kmalloc-1024"};
+static UCHAR kmalloc_ready = 0;
+
+static void slab_link(kmem_slab **list, kmem_slab *slab)
+{
+	slab->prev = 0;
+	slab->next = *list;
+	if (*list) (*list)->prev = slab;
+	*list = slab;
+}
+
+static void slab_unlink(kmem_slab **list, kmem_slab *slab)
+{
+	if (slab->prev) slab->prev->next = slab->next;
+	else *list = slab->next;
+	if (slab->next) slab->next->prev = slab->prev;
+	slab->prev = slab->next = 0;
+}
+
+static kmem_slab *kmem_slab_of(const void *ptr)
+{
+	kmem_slab *slab = (kmem_slab *)ALIGN_DOWN((UINT)ptr);
+
+	if (!ptr || (UINT)ptr == (UINT)slab) return 0; //Objects never start a page
+	if (slab->magic != KMEM_MAGIC || slab->self != slab) return 0;
+	return slab;
+}
+
+//The magic only says it's a slab, the object must also be one of its objects and in use
+static int kmem_obj_index(kmem_slab *slab, const void *obj)
+{
+	kmem_cache *cache = slab->cache;
+	UINT offset = (UINT)obj - KMEM_FIRST_OBJ(slab), i = offset / cache->objsize;
+
+	if (((UINT)obj < KMEM_FIRST_OBJ(slab)) || (offset % cache->objsize) || (i >= cache->perslab)) return -1;
+	if (!(slab->inuse_map[i / 32] & (1U << (i % 32)))) return -1; //Double free
+	return i;
+}
+
+static kmem_slab *kmem_grow(kmem_cache *cache)
+{
+	kmem_slab *slab = (kmem_slab *)_kmalloc_a(FRAME_SIZE);
+	UINT i, obj;
+
+	if (!slab) return 0;
+	slab->magic = KMEM_MAGIC;
+	slab->self = slab;
+	slab->cache = cache;
+	slab->prev = slab->next = 0;
+	slab->inuse = 0;
+	slab->freelist = 0;
+	memset(slab->inuse_map, 0, sizeof(slab->inuse_map));
+	obj = KMEM_FIRST_OBJ(slab) + (cache->perslab - 1) * cache->objsize;
+	for (i = cache->perslab; i--; obj -= cache->objsize) {
+		*(void **)obj = slab->freelist;
+		slab->freelist = (void *)obj;
+	}
+	cache->nr_slabs++;
+	return slab;
+}
+
+static void kmem_cache_init(kmem_cache *cache, const char *name, UINT objsize)
+{
+	memset(cache, 0, sizeof(kmem_cache));
+	if (objsize < sizeof(void *)) objsize = sizeof(void *);
+	cache->objsize = (objsize + KMEM_ALIGN - 1) & ~(KMEM_ALIGN - 1);
+	cache->perslab = (FRAME_SIZE - (KMEM_FIRST_OBJ(0))) / cache->objsize;
+	cache->name = name;
+	cache->next = kmem_caches;
+	kmem_caches = cache;
+}
+
+kmem_cache *kmem_cache_create(const char *name, UINT objsize)
+{
+	kmem_cache *cache;
+
+	if (!objsize || objsize > FRAME_SIZE - KMEM_FIRST_OBJ(0)) return 0;
+	if (!(cache = malloc(sizeof(kmem_cache)))) return 0;
+	kmem_cache_init(cache, name, objsize);
+	return cache;
+}
+
+void *kmem_cache_alloc(kmem_cache *cache)
+{
+	kmem_slab *slab;
+	void *obj;
+	UINT i;
+
+	if (!cache) return 0;
+	if (!(slab = cache->partial)) {
+		if ((slab = cache->empty)) {
+			slab_unlink(&cache->empty, slab);
+			cache->nr_empty--;
+		} else if (!(slab = kmem_grow(cache))) return 0;
+		slab_link(&cache->partial, slab);
+	}
+	obj = slab->freelist;
+	slab->freelist = *(void **)obj;
+	i = ((UINT)obj - KMEM_FIRST_OBJ(slab)) / cache->objsize;
+	slab->inuse_map[i / 32] |= 1U << (i % 32);
+	if (++slab->inuse == cache->perslab) {
+		slab_unlink(&cache->partial, slab);
+		slab_link(&cache->full, slab);
+	}
+	cache->allocs++;
+	cache->active++;
+	return obj;
+}
+
+void *kmem_cache_zalloc(kmem_cache *cache)
+{
+	void *obj = kmem_cache_alloc(cache);
+
+	if (obj) memset(obj, 0, cache->objsize);
+	return obj;
+}
+
+static void kmem_slab_free(kmem_slab *slab, void *obj, UINT i)
+{
+	kmem_cache *cache = slab->cache;
+
+	slab->inuse_map[i / 32] &= ~(1U << (i % 32));
+	*(void **)obj = slab->freelist;
+	slab->freelist = obj;
+	if (slab->inuse-- == cache->perslab) {
+		slab_unlink(&cache->full, slab);
+		slab_link(&cache->partial, slab);
+	}
+	if (!slab->inuse) {
+		slab_unlink(&cache->partial, slab);
+		if (cache->nr_empty < KMEM_MAX_EMPTY) {
+			slab_link(&cache->empty, slab);
+			cache->nr_empty++;
+		} else {
+			slab->magic = 0;
+			cache->nr_slabs--;
+			free(slab);
+		}
+	}
+	cache->frees++;
+	cache->active--;
+}
+
+void kmem_cache_free(kmem_cache *cache, void *obj)
+{
+	kmem_slab *slab = kmem_slab_of(obj);
+	int i;
+
+	if (!obj) return;
+	if (!slab || slab->cache != cache || ((i = kmem_obj_index(slab, obj)) < 0)) {
+		printf("kmem_cache_free: bad or double free of 0x%X in %s\n", (UINT)obj, cache ? cache->name : "?");
+		return;
+	}
+	kmem_slab_free(slab, obj, i);
+}
+
+void setup_kmalloc_caches(void)
+{
+	UINT i;
+
+	for (i = 0; i < NR_KMALLOC_CACHES; i++)
+		kmem_cache_init(&kmalloc_caches[i], kmalloc_names[i], 1 << (i + KMALLOC_MIN_SHIFT));
+	kmalloc_ready = 1;
+}
+
+void *kmalloc_small(UINT size)
+{
+	UINT i = 0;
+
+	if (!kmalloc_ready || !size || size > (1 << KMALLOC_MAX_SHIFT)) return 0;
+	while ((1 << (i + KMALLOC_MIN_SHIFT)) < size) i++;
+	return kmem_cache_alloc(&kmalloc_caches[i]);
+}
+
+UINT kmalloc_obj_size(const void *ptr)
+{
+	kmem_slab *slab = kmem_slab_of(ptr);
+
+	if (!slab) return 0;
+	return slab->cache->objsize;
+}
+
+int kmalloc_free_obj(void *ptr)
+{
+	kmem_slab *slab = kmem_slab_of(ptr);
+	int i;
+
+	if (!slab) return 0;
+	if ((i = kmem_obj_index(slab, ptr)) < 0) {
+		printf("kfree: bad or double free of 0x%X in %s\n", (UINT)ptr, slab->cache->name);
+		return 1; //Not a heap block either
+	}
+	kmem_slab_free(slab, ptr, i);
+	return 1;
+}
@@ -0,0 +1,119 @@
+/*
+ *  Copyright (C) 2008 Sven Köhler
+ *
+ *  This file is part of Nupkux.
+ *
+ *  Nupkux is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nupkux is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Nupkux.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Copies from and to pointers handed in by a process. An instruction which
+ * may fault on such a pointer has an entry in __ex_table; if the page fault
+ * handler can't resolve the fault, it continues at the fixup instead and the
+ * copy returns how much is left.
+ */
+
+#include <paging.h>
+#include <lib/memory.h>
+#include <kernel/dts.h>
+
+typedef struct _exception_entry {
+	UINT insn, fixup;
+} exception_entry;
+
+extern exception_entry __start___ex_table[], __stop___ex_table[]; //link.ld
+
+#define EX_ENTRY(INSN,FIXUP)	".section __ex_table,\"a\"\n\t"	\
+				".align 4\n\t"				\
+				".long " #INSN "," #FIXUP "\n"		\
+				".previous\n"
+
+//Returns the bytes not copied, a dword across the bad page counts as not copied
+static UINT do_copy_user(void *to, const void *from, UINT n)
+{
+	int d0, d1, d2;
+
+	if ((n < 16) || mem_fast_strings) {
+		asm volatile (	"1:\trep movsb\n"
+		                "2:\n"
+		                EX_ENTRY(1b, 2b)
+		                :"=&c"(d0), "=&D"(d1), "=&S"(d2)
+		                :"0"(n), "1"(to), "2"(from)
+		                :"memory");
+		return d0;
+	}
+	asm volatile (	"1:\trep movsl\n\t"
+	                "movl %3,%%ecx\n"
+	                "2:\trep movsb\n"
+	                "3:\n"
+	                ".section .fixup,\"ax\"\n"
+	                "4:\tleal (%3,%%ecx,4),%%ecx\n\t"
+	                "jmp 3b\n"
+	                ".previous\n"
+	                EX_ENTRY(1b, 4b)
+	                EX_ENTRY(2b, 3b)
+	                :"=&c"(d0), "=&D"(d1), "=&S"(d2)
+	                :"r"(n & 3), "0"(n / 4), "1"(to), "2"(from)
+	                :"memory");
+	return d0;
+}
+
+UINT copy_from_user(void *to, const void *from, UINT n)
+{
+	if (!access_ok(VERIFY_READ, from, n)) return n;
+	return do_copy_user(to, from, n);
+}
+
+UINT copy_to_user(void *to, const void *from, UINT n)
+{
+	if (!access_ok(VERIFY_WRITE, to, n)) return n;
+	return do_copy_user(to, from, n);
+}
+
+//Length including the 0, 0 on a fault and more than max if there is no 0
+UINT strnlen_user(const char *s, UINT max)
+{
+	UINT res;
+	int d0, d1;
+
+	if (!max || !access_ok(VERIFY_READ, s, 1)) return 0;
+	asm volatile (	"1:\trepne scasb\n\t"
+	                "jne 3f\n\t"
+	                "subl %%ecx,%0\n\t"
+	                "jmp 2f\n"
+	                "3:\tincl %0\n"
+	                "2:\n"
+	                ".section .fixup,\"ax\"\n"
+	                "4:\txorl %0,%0\n\t"
+	                "jmp 2b\n"
+	                ".previous\n"
+	                EX_ENTRY(1b, 4b)
+	                :"=&r"(res), "=&c"(d0), "=&D"(d1)
+	                :"0"(max), "1"(max), "2"(s), "a"(0)
+	                :"memory", "cc");
+	return res;
+}
+
+//Called by the page fault handler, 1 if the faulting instruction had a fixup
+int fixup_exception(registers *regs)
+{
+	exception_entry *entry;
+
+	for (entry = __start___ex_table; entry < __stop___ex_table; entry++) {
+		if (entry->insn != regs->eip) continue;
+		regs->eip = entry->fixup;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,168 @@
+/*
+ *  Copyright (C) 2008 Sven Köhler
+ *
+ *  This file is part of Nupkux.
+ *
+ *  Nupkux is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nupkux is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Nupkux.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <vma.h>
+#include <task.h>
+#include <errno.h>
+
+vm_area *vma_find(vm_area *list, UINT address)
+{
+	for (; list; list = list->next)
+		if ((list->start <= address) && (address < list->end)) return list;
+	return 0;
+}
+
+vm_area *vma_overlap(vm_area *list, UINT start, UINT end)
+{
+	for (; list; list = list->next)
+		if ((list->start < end) && (start < list->end)) return list;
+	return 0;
+}
+
+UINT vma_top(vm_area *list)
+{
+	UINT res = 0;
+
+	for (; list; list = list->next)
+		if (list->end > res) res = list->end;
+	return res;
+}
+
+int vma_map(vm_area **list, UINT address, UINT size, UINT flags, vnode *node, off_t offset, UINT filesz)
+{
+	vm_area *area;
+	UINT skip = CHECK_ALIGN(address);
+
+	if (!size) return 0;
+	if (node && (offset < skip)) return -EINVAL;
+	if (!(area = malloc(sizeof(vm_area)))) return -ENOMEM;
+	area->start = ALIGN_DOWN(address);
+	area->end = address + size;
+	if (CHECK_ALIGN(area->end)) area->end = ALIGN_UP(area->end);
+	area->flags = flags;
+	area->node = node;
+	area->offset = (node) ? offset - skip : 0;
+	area->filesz = (node) ? filesz + skip : 0;
+	if (node) node->count++;
+	area->next = *list;
+	*list = area;
+	return 0;
+}
+
+vm_area *vma_clone(vm_area *list)
+{
+	vm_area *res = 0, **last = &res;
+
+	for (; list; list = list->next) {
+		if (!(*last = malloc(sizeof(vm_area)))) break;
+		**last = *list;
+		if (list->node) list->node->count++;
+		last = &((*last)->next);
+	}
+	*last = 0;
+	return res;
+}
+
+static void vma_cut_head(vm_area *area, UINT start)
+{
+	UINT cut = start - area->start;
+
+	area->start = start;
+	if (!area->node) return;
+	area->offset += cut;
+	area->filesz = (area->filesz > cut) ? area->filesz - cut : 0;
+}
+
+//Takes the page aligned range [start,end) out of the areas, cutting them where needed
+int vma_unmap(vm_area **list, UINT start, UINT end, page_directory *directory)
+{
+	vm_area *area, *tail;
+	UINT i, from, to;
+
+	while ((area = *list)) {
+		if ((area->end <= start) || (end <= area->start)) {
+			list = &area->next;
+			continue;
+		}
+		from = (area->start > start) ? area->start : start;
+		to = (area->end < end) ? area->end : end;
+		tail = 0;
+		if ((from > area->start) && (to < area->end)) {
+			if (!(tail = malloc(sizeof(vm_area)))) return -ENOMEM;
+			*tail = *area;
+			if (tail->node) tail->node->count++;
+			vma_cut_head(tail, to);
+			area->next = tail;
+		}
+		for (i = from; i < to; i += FRAME_SIZE)
+			free_page(i, directory);
+		if ((from == area->start) && (to == area->end)) {
+			*list = area->next;
+			iput(area->node);
+			free(area);
+			continue;
+		}
+		if (from == area->start) vma_cut_head(area, to);
+		else area->end = from;
+		list = (tail) ? &tail->next : &area->next;
+	}
+	return 0;
+}
+
+void vma_unmap_all(vm_area **list, page_directory *directory)
+{
+	vm_area *area;
+	UINT i;
+
+	while ((area = *list)) {
+		*list = area->next;
+		for (i = area->start; i < area->end; i += FRAME_SIZE)
+			free_page(i, directory);
+		iput(area->node);
+		free(area);
+	}
+}
+
+int vma_fault(UINT address, int write)
+{
+	vm_area *area = vma_find(current_task->vmas, address);
+	UINT pos, size = 0;
+	page *apage;
+	int len = 0;
+
+	if (!area) return 0;
+	address = ALIGN_DOWN(address);
+	pos = address - area->start;
+	if (pos >= area->filesz) { //Nothing to read, the page starts out zero
+		if (write) apage = make_zeroed_page(address, area->flags, current_directory);
+		else apage = map_zero_page(address, area->flags, current_directory);
+		if (!apage || !apage->frame) return 0; //Out of memory, fixup or abort
+		invlpg(address);
+		return 1;
+	}
+	apage = make_page(address, PAGE_FLAG_PRESENT | PAGE_FLAG_WRITE | PAGE_FLAG_USERMODE, current_directory, 1);
+	if (!apage || !apage->frame) return 0; //Reading into it would fault again
+	size = (area->filesz - pos < FRAME_SIZE) ? area->filesz - pos : FRAME_SIZE;
+	len = read_fs(area->node, area->offset + pos, size, (char *)address);
+	if (len < 0) len = 0;
+	if (len < FRAME_SIZE) memset((void *)(address + len), 0, FRAME_SIZE - len);
+	apage->flags = area->flags;
+	invlpg(address);
+	return 1;
+}
@@ -0,0 +1,118 @@
+/*
+ *  Copyright (C) 2008 Sven Köhler
+ *
+ *  This file is part of Nupkux.
+ *
+ *  Nupkux is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nupkux is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Nupkux.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Invariant checks of the kernel heap. Walks all blocks from start to end
+ * and all hole buckets, and compares both against the statistics.
+ */
+
+#include <mm.h>
+#include "heaptest.h"
+
+extern int printf(const char *fmt, ...);
+
+extern heap *kheap;
+
+#define FAIL(MSG, POS)	do { printf("heap: " MSG " at 0x%08X\n", (POS)); errors++; } while (0)
+
+static int check_blocks(UINT *holes)
+{
+	UINT pos = kheap->start, blocks = 0, used = 0;
+	mm_header *header, *next;
+	mm_footer *footer;
+	int errors = 0;
+
+	*holes = 0;
+	while (pos < kheap->end) {
+		header = (mm_header *)pos;
+		if (header->magic != MM_MAGIC) {
+			FAIL("bad header magic", pos);
+			return errors; //Can't walk any further
+		}
+		if (header->size < MM_MIN_BLOCK || header->size % MM_ALIGN || pos + header->size > kheap->end) {
+			FAIL("bad block size", pos);
+			return errors;
+		}
+		footer = (mm_footer *)(pos + header->size - sizeof(mm_footer));
+		if (footer->magic != MM_MAGIC || footer->header != header) FAIL("bad footer", pos);
+		next = (mm_header *)(pos + header->size);
+		if (header->flag == MM_FLAG_HOLE) {
+			(*holes)++;
+			if ((UINT)next < kheap->end && next->flag == MM_FLAG_HOLE) FAIL("uncoalesced holes", pos);
+		} else {
+			blocks++;
+			used += header->size;
+		}
+		pos += header->size;
+	}
+	if (pos != kheap->end) FAIL("last block overshoots the end", pos);
+	if (blocks != kheap->blocks) FAIL("block count differs from the statistics", blocks);
+	if (used != kheap->used) FAIL("used bytes differ from the statistics", used);
+	return errors;
+}
+
+static int check_buckets(UINT holes)
+{
+	UINT i, listed = 0;
+	mm_hole *hole;
+	int errors = 0;
+
+	for (i = 0; i < MM_NR_BUCKETS; i++) {
+		if (!kheap->buckets[i] != !(kheap->bucketmap & (1 << i))) FAIL("bucket bitmap is wrong", i);
+		for (hole = kheap->buckets[i]; hole; hole = hole->next, listed++) {
+			if (hole->header.flag != MM_FLAG_HOLE) FAIL("block in a hole bucket", (UINT)hole);
+			if (hole->header.size < (1U << i) || (i < MM_NR_BUCKETS - 1 && hole->header.size >= (2U << i)))
+				FAIL("hole in the wrong bucket", (UINT)hole);
+			if (hole->next && hole->next->prev != hole) FAIL("broken hole links", (UINT)hole);
+		}
+	}
+	if (listed != holes || listed != kheap->holes) FAIL("hole count differs", listed);
+	return errors;
+}
+
+int kh_check(void)
+{
+	UINT holes;
+	int errors = check_blocks(&holes);
+
+	if (errors) return errors;
+	return check_buckets(holes);
+}
+
+void kh_get_stats(kh_stats *stats)
+{
+	heap_info info;
+
+	heap_get_info(kheap, &info);
+	stats->size = info.size;
+	stats->used = kheap->used;
+	stats->peak = kheap->peak;
+	stats->blocks = kheap->blocks;
+	stats->allocs = kheap->allocs;
+	stats->frees = kheap->frees;
+	stats->holes = info.holes;
+	stats->free = info.free;
+	stats->largest = info.largest;
+	stats->expands = kheap->expands;
+	stats->contracts = kheap->contracts;
+	stats->pages_mapped = kheap->pages_mapped;
+	stats->pages_unmapped = kheap->pages_unmapped;
+	stats->inplace = kheap->reallocs_inplace;
+	stats->moved = kheap->reallocs_moved;
+}
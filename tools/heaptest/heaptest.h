@@ -0,0 +1,52 @@
+/*
+ *  Copyright (C) 2008 Sven Köhler
+ *
+ *  This file is part of Nupkux.
+ *
+ *  Nupkux is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nupkux is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Nupkux.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Interface between the harness, built against the host libc, and the
+ * kernel side (src/mm and the fake paging layer), built freestanding with
+ * the kernel headers. Only plain C types cross this border.
+ */
+
+#ifndef _HEAPTEST_H
+#define _HEAPTEST_H
+
+typedef struct _kh_stats {
+	unsigned int size, used, peak;
+	unsigned int blocks, allocs, frees;
+	unsigned int holes, free, largest;
+	unsigned int expands, contracts;
+	unsigned int pages_mapped, pages_unmapped;
+	unsigned int inplace, moved;
+} kh_stats;
+
+/* The kernel's malloc family, renamed by the Makefile */
+extern void *kern_malloc(unsigned int size);
+extern void *kern_calloc(unsigned int num, unsigned int size);
+extern void *kern_realloc(void *ptr, unsigned int size);
+extern void kern_free(void *ptr);
+extern unsigned int _kmalloc_a(unsigned int sz);
+
+/* paging.c */
+extern void kh_setup(void *arena, unsigned int size);
+
+/* check.c */
+extern int kh_check(void);
+extern void kh_get_stats(kh_stats *stats);
+
+#endif
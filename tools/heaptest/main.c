@@ -0,0 +1,215 @@
+/*
+ *  Copyright (C) 2008 Sven Köhler
+ *
+ *  This file is part of Nupkux.
+ *
+ *  Nupkux is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nupkux is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Nupkux.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host harness for the kernel heap (src/mm/mm.c and src/mm/slab.c). Runs
+ * randomized malloc/realloc/free traces against a fake paging layer, checks
+ * the contents of every object and the heap invariants, and reports the
+ * speed and the fragmentation left behind.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "heaptest.h"
+
+#define ARENA_SIZE	(64 << 20)
+#define NR_SLOTS	4096
+
+typedef struct _trace {
+	const char *name;
+	unsigned int small, large;	//Object sizes: 1..small mostly, 1..large every fourth
+	unsigned int realloc, aligned;	//Percent of the operations
+} trace;
+
+typedef struct _slot {
+	unsigned char *ptr;
+	unsigned int size;
+	unsigned char tag;
+} slot;
+
+static const trace traces[] = {
+	{"mixed", 300, 20000, 40, 10},
+	{"small", 128, 1024, 10, 0},
+	{"large", 4096, 32768, 20, 5},
+	{"realloc", 256, 32768, 80, 0},
+};
+
+static char arena[ARENA_SIZE] __attribute__((aligned(4096)));
+static slot slots[NR_SLOTS];
+
+static unsigned int check_every = 1000;
+static int benchmark = 0;
+
+static void fill(slot *s)
+{
+	if (!benchmark) memset(s->ptr, s->tag, s->size);
+}
+
+static int intact(slot *s, unsigned int size)
+{
+	unsigned int i;
+
+	if (benchmark) return 1;
+	for (i = 0; i < size; i++)
+		if (s->ptr[i] != s->tag) return 0;
+	return 1;
+}
+
+static unsigned int object_size(const trace *t)
+{
+	if (rand() % 4) return rand() % t->small + 1;
+	return rand() % t->large + 1;
+}
+
+static int do_op(const trace *t, unsigned long op)
+{
+	slot *s = &slots[rand() % NR_SLOTS];
+	unsigned int size = object_size(t), kept;
+	unsigned char *ptr;
+
+	if (!s->ptr) {
+		if (rand() % 100 < t->aligned) {
+			ptr = (unsigned char *)(unsigned long)_kmalloc_a(size);
+			if (((unsigned long)ptr) & 0xFFF) {
+				printf("op %lu: _kmalloc_a(%u) not page aligned\n", op, size);
+				return -1;
+			}
+		} else ptr = kern_malloc(size);
+		if (!ptr) {
+			printf("op %lu: malloc(%u) failed\n", op, size);
+			return -1;
+		}
+		s->ptr = ptr;
+		s->size = size;
+		s->tag = rand();
+		fill(s);
+		return 0;
+	}
+	if (!intact(s, s->size)) {
+		printf("op %lu: object at %p corrupted\n", op, s->ptr);
+		return -1;
+	}
+	if (rand() % 100 >= t->realloc) {
+		kern_free(s->ptr);
+		s->ptr = 0;
+		return 0;
+	}
+	if (!(ptr = kern_realloc(s->ptr, size))) {
+		printf("op %lu: realloc(%u) failed\n", op, size);
+		return -1;
+	}
+	kept = (size < s->size) ? size : s->size;
+	s->ptr = ptr;
+	if (!intact(s, kept)) {
+		printf("op %lu: realloc lost the contents\n", op);
+		return -1;
+	}
+	s->size = size;
+	fill(s);
+	return 0;
+}
+
+static int check(unsigned long op)
+{
+	int errors;
+
+	if (benchmark || !(errors = kh_check())) return 0;
+	printf("op %lu: %d heap invariant(s) broken\n", op, errors);
+	return -1;
+}
+
+static void report(const trace *t, unsigned long ops, double secs)
+{
+	kh_stats stats;
+	double frag;
+
+	kh_get_stats(&stats);
+	frag = stats.free ? 100.0 - 100.0 * stats.largest / stats.free : 0; //Free space not in the largest hole
+	printf("%-8s %9lu ops %7.3f s %10.0f ops/s  peak %8u  holes %5u  free %8u  largest %8u  frag %5.1f%%  expands %u contracts %u  pages %u in %u out  realloc %u in place %u moved\n",
+		t->name, ops, secs, secs > 0 ? ops / secs : 0, stats.peak, stats.holes, stats.free, stats.largest, frag, stats.expands, stats.contracts, stats.pages_mapped, stats.pages_unmapped, stats.inplace, stats.moved);
+}
+
+static int run(const trace *t, unsigned long ops, unsigned int seed)
+{
+	struct timespec start, end;
+	unsigned long op;
+	unsigned int i;
+	double secs;
+
+	memset(slots, 0, sizeof(slots));
+	kh_setup(arena, ARENA_SIZE);
+	srand(seed);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (op = 0; op < ops; op++) {
+		if (do_op(t, op)) return -1;
+		if (check_every && !(op % check_every) && check(op)) return -1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	report(t, ops, secs); //Fragmentation while the objects are still live
+	if (check(ops)) return -1;
+	for (i = 0; i < NR_SLOTS; i++)
+		if (slots[i].ptr) {
+			if (!intact(&slots[i], slots[i].size)) {
+				printf("slot %u corrupted at the end\n", i);
+				return -1;
+			}
+			kern_free(slots[i].ptr);
+		}
+	return check(ops);
+}
+
+static void usage(const char *prog)
+{
+	printf("Usage: %s [-b] [-n ops] [-s seed] [-c interval] [-t trace]\n", prog);
+	printf("  -b  benchmark: no content or invariant checks\n");
+	printf("  -c  check the heap invariants every interval ops, 0 only at the end\n");
+	printf("  -t  run only the given trace: mixed, small, large or realloc\n");
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long ops = 200000;
+	unsigned int seed = 1, i;
+	const char *only = 0;
+	int opt, failed = 0;
+
+	for (opt = 1; opt < argc; opt++) {
+		if (!strcmp(argv[opt], "-b")) benchmark = 1;
+		else if (opt + 1 < argc && !strcmp(argv[opt], "-n")) ops = strtoul(argv[++opt], 0, 0);
+		else if (opt + 1 < argc && !strcmp(argv[opt], "-s")) seed = strtoul(argv[++opt], 0, 0);
+		else if (opt + 1 < argc && !strcmp(argv[opt], "-c")) check_every = strtoul(argv[++opt], 0, 0);
+		else if (opt + 1 < argc && !strcmp(argv[opt], "-t")) only = argv[++opt];
+		else {
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	if (benchmark) check_every = 0;
+	for (i = 0; i < sizeof(traces) / sizeof(trace); i++) {
+		if (only && strcmp(only, traces[i].name)) continue;
+		if (run(&traces[i], ops, seed)) {
+			printf("%s: FAILED (seed %u)\n", traces[i].name, seed);
+			failed = 1;
+		}
+	}
+	return failed;
+}
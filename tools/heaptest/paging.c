@@ -0,0 +1,81 @@
+/*
+ *  Copyright (C) 2008 Sven Köhler
+ *
+ *  This file is part of Nupkux.
+ *
+ *  Nupkux is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nupkux is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Nupkux.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Fake paging layer: the heap lives in a static arena of the harness, which
+ * is always present, so mapping a page is just bookkeeping.
+ */
+
+#include <mm.h>
+
+page_directory *kernel_directory = 0, *current_directory = 0;
+UINT nr_frames = 0, nr_free_frames = 0;	//Never short of frames
+UINT __working_memstart = 0;
+ULONG memory_end = 0;
+
+static page fake_page;
+
+extern UINT kmalloc_pos;
+extern heap *kheap;
+
+page *make_page(UINT address, UINT flags, page_directory *directory, int alloc)
+{
+	fake_page.flags = PAGE_FLAG_PRESENT;
+	fake_page.frame = address / FRAME_SIZE;
+	return &fake_page;
+}
+
+page *get_page(UINT address, int make, page_directory *directory)
+{
+	fake_page.flags = PAGE_FLAG_PRESENT;
+	fake_page.frame = address / FRAME_SIZE;
+	return &fake_page;
+}
+
+page *free_page(UINT address, page_directory *directory)
+{
+	return &fake_page;
+}
+
+void *memcpy(void *target, const void *src, size_t count)
+{
+	return __builtin_memcpy(target, src, count);
+}
+
+void *memset(void *target, int value, size_t count)
+{
+	return __builtin_memset(target, value, count);
+}
+
+int memcmp(const void *s1, const void *s2, size_t n)
+{
+	return __builtin_memcmp(s1, s2, n);
+}
+
+//Same layout as setup_paging: placement area, then the heap up to the end of the arena
+void kh_setup(void *arena, UINT size)
+{
+	memset(arena, 0, size); //Stale slab headers of the last trace would look alive
+	kheap = 0;
+	kmem_caches = 0;
+	kmalloc_pos = (UINT)arena;
+	memory_end = (UINT)arena + size;
+	kheap = create_heap(MM_KHEAP_START + kmalloc_pos, MM_KHEAP_START + MM_KHEAP_SIZE + kmalloc_pos, memory_end, 0);
+	setup_kmalloc_caches();
+}
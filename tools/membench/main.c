@@ -0,0 +1,168 @@
+/*
+ *  Copyright (C) 2008 Sven Köhler
+ *
+ *  This file is part of Nupkux.
+ *
+ *  Nupkux is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nupkux is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Nupkux.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host benchmark for the string functions of the kernel (src/lib/memory.c),
+ * the userspace libc has the same code. Compares them with plain byte loops
+ * and the host libc across sizes and alignments.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BUFSIZE		(1 << 20)
+#define BYTES_PER_TEST	(64 << 20)	//Moved per size, so every size runs about as long
+
+typedef struct _impl {
+	const char *name;
+	int fast_strings;	//What the kernel code uses, -1 for the others
+	void *(*copy)(void *, const void *, size_t);
+	void *(*set)(void *, int, size_t);
+	int (*cmp)(const void *, const void *, size_t);
+} impl;
+
+extern void *kern_memcpy(void *target, const void *src, size_t count);
+extern void *kern_memset(void *target, int value, size_t count);
+extern int kern_memcmp(const void *s1, const void *s2, size_t n);
+extern void setup_memory_functions(void);
+extern unsigned char mem_fast_strings;
+
+static void *byte_memcpy(void *target, const void *src, size_t count)
+{
+	volatile char *tmp = target;
+	const char *source = src;
+
+	while (count--) *(tmp++) = *(source++);
+	return target;
+}
+
+static void *byte_memset(void *target, int value, size_t count)
+{
+	volatile char *tmp = target;
+
+	while (count--) *(tmp++) = value;
+	return target;
+}
+
+static int byte_memcmp(const void *s1, const void *s2, size_t n)
+{
+	const volatile unsigned char *p1 = s1, *p2 = s2;
+
+	for (; n; n--, p1++, p2++)
+		if (*p1 != *p2) return *p1 - *p2;
+	return 0;
+}
+
+static const impl impls[] = {
+	{"bytewise", -1, byte_memcpy, byte_memset, byte_memcmp},
+	{"dwords", 0, kern_memcpy, kern_memset, kern_memcmp},
+	{"rep movsb", 1, kern_memcpy, kern_memset, kern_memcmp},
+	{"host libc", -1, memcpy, memset, memcmp},
+};
+
+static const size_t sizes[] = {8, 16, 64, 256, 1024, 4096, 65536, BUFSIZE - 16};
+
+static char src[BUFSIZE] __attribute__((aligned(4096)));
+static char dest[BUFSIZE] __attribute__((aligned(4096)));
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double run(const impl *im, int op, size_t size, size_t misalign)
+{
+	unsigned long i, rounds = BYTES_PER_TEST / size;
+	volatile int sink = 0;
+	double start;
+
+	if (im->fast_strings >= 0) mem_fast_strings = im->fast_strings;
+	start = now();
+
+	for (i = 0; i < rounds; i++)
+		switch (op) {
+		case 0:
+			im->copy(dest + misalign, src, size);
+			break;
+		case 1:
+			im->set(dest + misalign, i, size);
+			break;
+		default:
+			sink += im->cmp(dest + misalign, src + misalign, size);
+			break;
+		}
+	return (double)rounds * size / (now() - start) / (1 << 20);
+}
+
+static int verify(const impl *im)
+{
+	size_t size, off;
+	int i;
+
+	if (im->fast_strings >= 0) mem_fast_strings = im->fast_strings;
+	for (i = 0; i < BUFSIZE; i++) src[i] = rand();
+	for (size = 0; size < 300; size++)
+		for (off = 0; off < 8; off++) {
+			memset(dest, 0x5A, 512);
+			im->copy(dest + off, src + 3, size);
+			if (memcmp(dest + off, src + 3, size) || dest[off + size] != 0x5A) return -1;
+			im->set(dest + off, 0xA5, size);
+			for (i = 0; i < size; i++)
+				if ((unsigned char)dest[off + i] != 0xA5) return -1;
+			if (dest[off + size] != 0x5A) return -1;
+			memcpy(dest + off, src + off, size);
+			if (im->cmp(dest + off, src + off, size)) return -1;
+			if (size && ((dest[off + size - 1] ^= 1), !im->cmp(dest + off, src + off, size))) return -1;
+		}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	static const char *ops[] = {"memcpy", "memset", "memcmp"};
+	unsigned int i, j, op;
+	size_t misalign;
+
+	setup_memory_functions();
+	printf("Kernel picks: %s\n", (mem_fast_strings) ? "rep movsb (ERMS)" : "dwords");
+	for (i = 0; i < sizeof(impls) / sizeof(impl); i++)
+		if (verify(&impls[i])) {
+			printf("%s: wrong results\n", impls[i].name);
+			return 1;
+		}
+	memcpy(dest, src, BUFSIZE);
+	for (op = 0; op < 3; op++)
+		for (misalign = 0; misalign < 2; misalign++) {
+			printf("\n%s%s (MB/s)\n%-10s", ops[op], (misalign) ? ", destination misaligned" : "", "size");
+			for (i = 0; i < sizeof(impls) / sizeof(impl); i++) printf("%12s", impls[i].name);
+			printf("\n");
+			for (j = 0; j < sizeof(sizes) / sizeof(size_t); j++) {
+				printf("%-10u", (unsigned int)sizes[j]);
+				for (i = 0; i < sizeof(impls) / sizeof(impl); i++)
+					printf("%12.0f", run(&impls[i], op, sizes[j], misalign));
+				printf("\n");
+			}
+		}
+	return 0;
+}
@@ -20,8 +20,15 @@
 #ifndef _STDLIB_H
 #define _STDLIB_H
 
+#include <unistd.h>
+
 #define is_digit(C)		((unsigned int) ((C)-'0')<10u)
 
 extern int atoi(const char *str);
 
+extern void *malloc(size_t size);
+extern void *calloc(size_t num, size_t size);
+extern void *realloc(void *ptr, size_t size);
+extern void free(void *ptr);
+
 #endif
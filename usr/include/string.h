@@ -29,5 +29,8 @@ extern char *strcpy(char *dest, const char *src);
 extern char *strncpy(char *dest, const char *src, size_t num);
 extern char *strtok(char *s, const char *delim);
 extern char *strtok_save(char *s, const char *delim, char **ptr);
+extern void *memcpy(void *dest, const void *src, size_t n);
+extern void *memset(void *s, int c, size_t n);
+extern int memcmp(const void *s1, const void *s2, size_t n);
 
 #endif
@@ -18,6 +18,9 @@
  */
 
 #include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <time.h>
 
 int errno = 0;
 
@@ -44,3 +47,53 @@ _syscall1(int, reboot, int, howto);
 
 
 
+
+static void *curbrk = 0;
+
+//The kernel answers with the new break, or the old one if it can't move
+static void *do_brk(void *addr)
+{
+	void *res;
+	__asm__ volatile ("int $0x80"
+		: "=a" (res)
+		: "a" (__NR_brk), "b" (addr));
+	return res;
+}
+
+int brk(void *addr)
+{
+	if ((curbrk = do_brk(addr)) != addr) {
+		errno = ENOMEM;
+		return -1;
+	}
+	return 0;
+}
+
+void *sbrk(int increment)
+{
+	void *old;
+
+	if (!curbrk) curbrk = do_brk(0);
+	old = curbrk;
+	if (increment && brk((char *)old + increment)) return (void *)-1;
+	return old;
+}
+
+void *mmap(void *addr, size_t len, int prot, int flags, int fd, unsigned int offset)
+{
+	struct mmap_args args = {(unsigned int)addr, len, prot, flags, fd, offset};
+	int res;
+
+	__asm__ volatile ("int $0x80"
+		: "=a" (res)
+		: "a" (__NR_mmap), "b" (&args)
+		: "memory");
+	if (res < 0) {
+		errno = -res;
+		return MAP_FAILED;
+	}
+	return (void *)res;
+}
+
+_syscall2(int, munmap, void *, addr, size_t, len);
+_syscall2(int, nanosleep, const struct timespec *, req, struct timespec *, rem);
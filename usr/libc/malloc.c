@@ -0,0 +1,147 @@
+/*
+ *  Copyright (C) 2008 Sven Köhler
+ *
+ *  This file is part of Nupkux.
+ *
+ *  Nupkux is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nupkux is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Nupkux.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Small blocks come in size classes cut out of the heap (sbrk), freed ones
+ * wait in one list per class, so both directions are a pointer swap. Blocks
+ * above MALLOC_MAX_SMALL get their own anonymous mapping, which goes back
+ * to the kernel when they are freed.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define MALLOC_PAGE		4096
+#define MALLOC_CHUNK		0x4000	//The heap grows by 16KB at least
+#define MALLOC_MAX_SMALL	4096	//Including the header
+#define MALLOC_NR_CLASSES	24
+#define MALLOC_MAPPED		MALLOC_NR_CLASSES
+
+typedef struct _malloc_header {
+	size_t size;		//Usable bytes behind the header
+	unsigned int class;
+} malloc_header;
+
+typedef struct _malloc_free {
+	struct _malloc_free *next;
+} malloc_free;
+
+static const size_t class_size[MALLOC_NR_CLASSES] = {
+	16, 32, 48, 64, 80, 96, 112, 128, 144, 160, 176, 192, 208, 224, 240, 256,
+	384, 512, 768, 1024, 1536, 2048, 3072, 4096
+};
+
+static malloc_free *free_list[MALLOC_NR_CLASSES];
+static char *arena_pos = 0, *arena_end = 0;
+
+static unsigned int size_class(size_t size)
+{
+	unsigned int i = 16;
+
+	if (size <= 256) return (size - 1) / 16;
+	while (class_size[i] < size) i++;
+	return i;
+}
+
+static malloc_header *arena_alloc(size_t size)
+{
+	size_t grow = (size > MALLOC_CHUNK) ? size : MALLOC_CHUNK;
+	char *res;
+
+	if (arena_end - arena_pos < size) {
+		if ((res = sbrk(grow)) == (void *)-1) return 0;
+		if (res != arena_end) arena_pos = res; //Someone else moved the break, the rest is lost
+		arena_end = res + grow;
+	}
+	res = arena_pos;
+	arena_pos += size;
+	return (malloc_header *)res;
+}
+
+static void *map_alloc(size_t size)
+{
+	malloc_header *header;
+
+	size = (size + MALLOC_PAGE - 1) & ~(MALLOC_PAGE - 1);
+	header = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (header == MAP_FAILED) return 0;
+	header->size = size - sizeof(malloc_header);
+	header->class = MALLOC_MAPPED;
+	return header + 1;
+}
+
+void *malloc(size_t size)
+{
+	malloc_header *header;
+	unsigned int class;
+
+	if (!size || size > ~(size_t)0 - MALLOC_PAGE) return 0;
+	size += sizeof(malloc_header);
+	if (size > MALLOC_MAX_SMALL) return map_alloc(size);
+	class = size_class(size);
+	if (free_list[class]) {
+		header = (malloc_header *)free_list[class];
+		free_list[class] = free_list[class]->next;
+	} else if (!(header = arena_alloc(class_size[class]))) return 0;
+	header->size = class_size[class] - sizeof(malloc_header);
+	header->class = class;
+	return header + 1;
+}
+
+void *calloc(size_t num, size_t size)
+{
+	void *res;
+
+	if (size && num > ~(size_t)0 / size) return 0;
+	if ((res = malloc(num * size))) memset(res, 0, num * size);
+	return res;
+}
+
+void free(void *ptr)
+{
+	malloc_header *header = (malloc_header *)ptr - 1;
+	malloc_free *block = (malloc_free *)header;
+
+	if (!ptr) return;
+	if (header->class == MALLOC_MAPPED) {
+		munmap(header, header->size + sizeof(malloc_header));
+		return;
+	}
+	block->next = free_list[header->class];
+	free_list[header->class] = block;
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	malloc_header *header = (malloc_header *)ptr - 1;
+	void *res;
+
+	if (!ptr) return malloc(size);
+	if (!size) {
+		free(ptr);
+		return 0;
+	}
+	if (size <= header->size) return ptr;
+	if (!(res = malloc(size))) return 0;
+	memcpy(res, ptr, header->size);
+	free(ptr);
+	return res;
+}
@@ -120,3 +120,88 @@ char *strtok(char *s, const char *delim)
 {
 	return strtok_save(s, delim, &strtok_save_ptr);
 }
+
+/*
+ * Same as in the kernel: one rep movsb/stosb if the CPU has ERMS (looked up
+ * on the first call), otherwise dwords once the destination is aligned.
+ */
+static int fast_strings = -1;
+
+static int has_fast_strings(void)
+{
+	unsigned int eax = 0, ebx, ecx = 0, edx;
+
+	if (fast_strings >= 0) return fast_strings;
+	__asm__ volatile ("cpuid" : "+a" (eax), "=b" (ebx), "+c" (ecx), "=d" (edx));
+	fast_strings = 0;
+	if (eax >= 7) {
+		eax = 7;
+		ecx = 0;
+		__asm__ volatile ("cpuid" : "+a" (eax), "=b" (ebx), "+c" (ecx), "=d" (edx));
+		fast_strings = !!(ebx & 0x200);
+	}
+	return fast_strings;
+}
+
+void *memcpy(void *dest, const void *src, size_t n)
+{
+	unsigned int head = (-(unsigned int)dest) & 3;
+	int d0, d1, d2;
+
+	if ((n < 16) || has_fast_strings()) {
+		__asm__ volatile ("rep movsb"
+			: "=&c" (d0), "=&D" (d1), "=&S" (d2)
+			: "0" (n), "1" (dest), "2" (src)
+			: "memory");
+		return dest;
+	}
+	__asm__ volatile ("rep movsb\n\t"
+		"movl %4,%%ecx\n\t"
+		"rep movsl\n\t"
+		"movl %5,%%ecx\n\t"
+		"rep movsb"
+		: "=&c" (d0), "=&D" (d1), "=&S" (d2)
+		: "0" (head), "g" ((n - head) / 4), "g" ((n - head) & 3), "1" (dest), "2" (src)
+		: "memory");
+	return dest;
+}
+
+void *memset(void *s, int c, size_t n)
+{
+	unsigned int head = (-(unsigned int)s) & 3;
+	int d0, d1;
+
+	if ((n < 16) || has_fast_strings()) {
+		__asm__ volatile ("rep stosb"
+			: "=&c" (d0), "=&D" (d1)
+			: "a" (c), "0" (n), "1" (s)
+			: "memory");
+		return s;
+	}
+	__asm__ volatile ("rep stosb\n\t"
+		"movl %3,%%ecx\n\t"
+		"rep stosl\n\t"
+		"movl %4,%%ecx\n\t"
+		"rep stosb"
+		: "=&c" (d0), "=&D" (d1)
+		: "a" ((unsigned char)c * 0x01010101), "g" ((n - head) / 4), "g" ((n - head) & 3), "0" (head), "1" (s)
+		: "memory");
+	return s;
+}
+
+int memcmp(const void *s1, const void *s2, size_t n)
+{
+	const unsigned int *w1 = s1, *w2 = s2;
+	const unsigned char *p1, *p2;
+
+	while ((n >= 4) && (*w1 == *w2)) {
+		w1++;
+		w2++;
+		n -= 4;
+	}
+	p1 = (const unsigned char *)w1;
+	p2 = (const unsigned char *)w2;
+	for (; n; n--, p1++, p2++)
+		if (*p1 != *p2) return *p1 - *p2;
+	return 0;
+}